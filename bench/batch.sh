@@ -0,0 +1,93 @@
+#!/bin/sh
+# How --batch scales with --jobs, against starting one process per script. Run it through
+# `make bench-batch` from the repo root, which builds the binary first; CLOX (environment)
+# names the binary.
+#
+# The scripts are small versions of the suite's workloads, with sizes that vary a lot from
+# one script to the next, so the workers' shares are uneven and have to be stolen to balance.
+# Every run's output is checked against the --jobs 1 run's, since it has to come out the same
+# however the scripts were scheduled.
+#
+# Knobs (environment): CLOX (binary), SCRIPTS (how many, default 400), RUNS (runs per job
+# count, default 5), MAX_JOBS (default: the number of cores).
+
+set -e
+
+CLOX=${CLOX:-./clox}
+SCRIPTS=${SCRIPTS:-400}
+RUNS=${RUNS:-5}
+MAX_JOBS=${MAX_JOBS:-$(getconf _NPROCESSORS_ONLN)}
+
+BUILD=bench/build
+SCRIPT_DIR="$BUILD/batch"
+
+. bench/median.sh
+
+rm -rf "$SCRIPT_DIR"
+mkdir -p "$SCRIPT_DIR"
+
+i=0
+while [ "$i" -lt "$SCRIPTS" ]; do
+    # every 16th script is about 30x the size of the smallest
+    size=$(( 50 + (i % 16) * 100 ))
+    name=$(printf "%s/%05d" "$SCRIPT_DIR" "$i")
+    case $(( i % 4 )) in
+        0) awk -v depth=20 -v terms="$size" -f bench/workloads/deep_arith.awk ;;
+        1) awk -v terms="$size" -f bench/workloads/string_concat.awk ;;
+        2) awk -v lines="$size" -f bench/workloads/literals.awk ;;
+        3) awk -v terms="$size" -f bench/workloads/comparisons.awk ;;
+    esac > "$name.lox"
+    i=$(( i + 1 ))
+done
+
+# milliseconds for the median of RUNS runs of the command
+timeRuns() {
+    walls=""
+    for run in $(seq "$RUNS"); do
+        start=$(date +%s%N)
+        "$@"
+        end=$(date +%s%N)
+        walls="$walls $(( end - start ))"
+    done
+    echo $walls | tr ' ' '\n' | median
+}
+
+processes() {
+    for script in "$SCRIPT_DIR"/*.lox; do
+        "$CLOX" --no-fold "$script" > /dev/null 2>&1 || true
+    done
+}
+
+batch() {
+    "$CLOX" --no-fold --batch "$SCRIPT_DIR" --jobs "$1" > "$BUILD/batch-$1.out" 2>&1 || true
+}
+
+printf "%d scripts, %d cores\n" "$SCRIPTS" "$(getconf _NPROCESSORS_ONLN)"
+printf "%-22s %10s %9s\n" mode "wall ms" speedup
+
+base=$(timeRuns processes)
+printf "%-22s %10.1f %9s\n" "process per script" "$(echo "$base" | awk '{ print $1 / 1e6 }')" "-"
+
+jobs=1
+single=""
+while :; do
+    wall=$(timeRuns batch "$jobs")
+    if [ -z "$single" ]; then
+        single=$wall
+    elif ! cmp -s "$BUILD/batch-1.out" "$BUILD/batch-$jobs.out"; then
+        echo "--jobs $jobs printed something different from --jobs 1" >&2
+        exit 1
+    fi
+
+    awk -v jobs="$jobs" -v wall="$wall" -v single="$single" 'BEGIN {
+        printf "%-22s %10.1f %8.2fx\n", "--batch --jobs " jobs, wall / 1e6, single / wall;
+    }'
+
+    if [ "$jobs" -ge "$MAX_JOBS" ]; then
+        break
+    fi
+    jobs=$(( jobs * 2 ))
+    if [ "$jobs" -gt "$MAX_JOBS" ]; then
+        jobs=$MAX_JOBS
+    fi
+done
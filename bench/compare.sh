@@ -0,0 +1,54 @@
+#!/bin/sh
+# Compares VM run time between the working tree and another commit (BASE), on the suite's
+# workloads with --no-fold so the VM does all the work. Run it through
+# `make bench-compare BASE=<commit>` from the repo root.
+#
+# Both are built with -O2 and the same DISPATCH/VALUE flags (FLAGS); the base also gets
+# -DCLOX_NO_DEBUG, which older trees needed to build without their compiled-in traces.
+# Runs alternate between the two binaries, and the run time is what --stats reports,
+# so BASE has to be a commit that has --stats.
+#
+# Knobs (environment): BASE (commit, default HEAD), FLAGS (extra gcc flags), RUNS
+# (runs per binary per workload, default 9).
+
+set -e
+
+BASE=${BASE:-HEAD}
+RUNS=${RUNS:-9}
+
+BUILD=bench/build
+SUITE="$BUILD/suite"
+BASE_TREE="$BUILD/base"
+
+. bench/median.sh
+
+rm -rf "$BASE_TREE"
+mkdir -p "$BASE_TREE"
+git archive "$BASE" | tar -x -C "$BASE_TREE"
+
+gcc -O2 -DCLOX_NO_DEBUG $FLAGS "$BASE_TREE"/*.c -o "$BUILD/clox-base" -pthread
+gcc -O2 $FLAGS *.c -o "$BUILD/clox-head" -pthread
+
+sh bench/generate.sh "$SUITE"
+
+echo "base: $(git rev-parse --short "$BASE"), head: working tree, median of $RUNS runs, --no-fold"
+printf "%-16s %12s %12s %8s\n" workload "base ms" "head ms" change
+
+for name in deep_arith string_concat literals comparisons; do
+    for binary in base head; do
+        : > "$BUILD/compare-$binary.stats"
+    done
+
+    for run in $(seq "$RUNS"); do
+        for binary in base head; do
+            "$BUILD/clox-$binary" --stats --no-fold "$SUITE/$name.lox" > /dev/null 2>> "$BUILD/compare-$binary.stats"
+        done
+    done
+
+    base=$(sed -n 's/.*"run_ns": \([0-9]*\).*/\1/p' "$BUILD/compare-base.stats" | median)
+    head=$(sed -n 's/.*"run_ns": \([0-9]*\).*/\1/p' "$BUILD/compare-head.stats" | median)
+
+    awk -v name="$name" -v base="$base" -v head="$head" 'BEGIN {
+        printf "%-16s %12.3f %12.3f %+7.1f%%\n", name, base / 1e6, head / 1e6, 100 * (head - base) / base;
+    }'
+done
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Chains of + compiled to OP_CONCAT (the default) against the pairwise OP_ADDs that
+# --no-fuse still emits. Run it through `make bench-concat` from the repo root, which builds
+# the binary first; CLOX (environment) names the binary.
+#
+# Each chain runs twice: with --no-fold, so the VM does the adding (run time), and as is,
+# where the compiler folds the constant chains (compile time). Times are medians of what
+# --stats reports.
+#
+# Knobs (environment): CLOX (binary), RUNS (runs per case, default 21).
+
+set -e
+
+CLOX=${CLOX:-./clox}
+RUNS=${RUNS:-21}
+
+BUILD=bench/build
+CHAINS="$BUILD/concat"
+mkdir -p "$CHAINS"
+
+. bench/median.sh
+
+awk -v terms=1000 -f bench/workloads/string_concat.awk > "$CHAINS/strings_1000.lox"
+awk -v terms=10000 -f bench/workloads/string_concat.awk > "$CHAINS/strings_10000.lox"
+# numbers, all on one line
+awk -v terms=1000 'BEGIN { for (t = 0; t < terms; t++) printf (t > 0 ? " + %d" : "%d"), t % 97; printf "\n" }' \
+    > "$CHAINS/numbers_1000.lox"
+
+# median of one --stats field over RUNS runs of the rest of the arguments
+medianStat() {
+    field=$1
+    shift
+    stats="$BUILD/concat.stats"
+    : > "$stats"
+    for run in $(seq "$RUNS"); do
+        "$CLOX" --stats "$@" > /dev/null 2>> "$stats"
+    done
+    sed -n "s/.*\"$field\": \([0-9]*\).*/\1/p" "$stats" | median
+}
+
+printf "%-14s %-9s %14s %14s %8s\n" chain time "OP_ADD us" "OP_CONCAT us" speedup
+
+for name in strings_1000 strings_10000 numbers_1000; do
+    script="$CHAINS/$name.lox"
+    for mode in run compile; do
+        if [ "$mode" = run ]; then
+            field=run_ns
+            fold=--no-fold
+        else
+            field=compile_ns
+            fold=
+        fi
+
+        pairwise=$(medianStat "$field" $fold --no-fuse "$script")
+        fused=$(medianStat "$field" $fold "$script")
+
+        awk -v name="$name" -v mode="$mode" -v pairwise="$pairwise" -v fused="$fused" 'BEGIN {
+            printf "%-14s %-9s %14.1f %14.1f %7.2fx\n", name, mode, pairwise / 1e3, fused / 1e3, pairwise / fused;
+        }'
+    done
+done
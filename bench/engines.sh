@@ -0,0 +1,47 @@
+#!/bin/sh
+# Compares the stack VM with the register VM (--engine register) on the suite's
+# workloads, with --no-fold so there's something left to run. Run it through
+# `make bench-engines` from the repo root, which builds the binary first; CLOX
+# (environment) names the binary.
+#
+# For each engine: instructions executed, median run time (what --stats reports, so the
+# register engine's translation isn't in it), and median wall time for the whole process.
+#
+# Knobs (environment): CLOX (binary), RUNS (runs per engine per workload, default 9).
+
+set -e
+
+CLOX=${CLOX:-./clox}
+RUNS=${RUNS:-9}
+
+BUILD=bench/build
+SUITE="$BUILD/suite"
+
+. bench/median.sh
+
+sh bench/generate.sh "$SUITE"
+
+printf "%-16s %-9s %12s %10s %10s\n" workload engine instructions "run ms" "wall ms"
+
+for name in deep_arith string_concat literals comparisons; do
+    for engine in stack register; do
+        stats="$BUILD/engines-$engine.stats"
+        : > "$stats"
+        walls=""
+
+        for run in $(seq "$RUNS"); do
+            start=$(date +%s%N)
+            "$CLOX" --stats --no-fold --engine "$engine" "$SUITE/$name.lox" > /dev/null 2>> "$stats"
+            end=$(date +%s%N)
+            walls="$walls $(( end - start ))"
+        done
+
+        wall=$(echo $walls | tr ' ' '\n' | median)
+        run_ns=$(sed -n 's/.*"run_ns": \([0-9]*\).*/\1/p' "$stats" | median)
+        instructions=$(sed -n 's/.*"instructions": \([0-9]*\).*/\1/p' "$stats" | tail -n 1)
+
+        awk -v name="$name" -v engine="$engine" -v instructions="$instructions" -v run_ns="$run_ns" -v wall="$wall" 'BEGIN {
+            printf "%-16s %-9s %12d %10.3f %10.3f\n", name, engine, instructions, run_ns / 1e6, wall / 1e6;
+        }'
+    done
+done
@@ -0,0 +1,94 @@
+// Number output throughput: prints the same numbers the way OP_RETURN used to (fprintf
+// "%g" and a fputc per value, straight to a FILE) and the way it does now (formatNumber
+// into a Writer), and reports ns per number for each. Built and run by bench/format.sh;
+// not part of clox itself.
+//
+// Also checks that both produce the same bytes, number for number.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../number.h"
+#include "../writer.h"
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the kinds of numbers scripts print: whole numbers, quotients, small decimals and
+// the odd huge or tiny one
+static double* makeNumbers(int count) {
+    double* numbers = malloc(sizeof(double) * count);
+    srand(12345);
+    for (int i = 0; i < count; i++) {
+        switch (i % 4) {
+            case 0: numbers[i] = rand() % 100000; break;
+            case 1: numbers[i] = (double) rand() / (1 + rand() % 1000); break;
+            case 2: numbers[i] = (rand() % 100000) / 100.0 - 500; break;
+            case 3: numbers[i] = (double) rand() * rand() * rand() / ((i % 3) ? 1e-12 : 1e30); break;
+        }
+    }
+    return numbers;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: format [count] [repeats]\n");
+        exit(64);
+    }
+
+    int count = atoi(argv[1]);
+    int repeats = atoi(argv[2]);
+    double* numbers = makeNumbers(count);
+
+    for (int i = 0; i < count; i++) {
+        char expected[64];
+        char actual[NUMBER_BUFFER_SIZE];
+        snprintf(expected, sizeof(expected), "%g", numbers[i]);
+        formatNumber(numbers[i], actual);
+        if (strcmp(expected, actual) != 0) {
+            fprintf(stderr, "%.17g: printf gives %s, formatNumber %s\n", numbers[i], expected, actual);
+            exit(1);
+        }
+    }
+
+    FILE* sink = fopen("/dev/null", "w");
+    double bestPrintf = -1;
+    double bestWriter = -1;
+    for (int r = 0; r < repeats; r++) {
+        double start = nowSeconds();
+        for (int i = 0; i < count; i++) {
+            fprintf(sink, "%g", numbers[i]);
+            fputc('\n', sink);
+        }
+        fflush(sink);
+        double elapsed = nowSeconds() - start;
+        if (bestPrintf < 0 || elapsed < bestPrintf) {
+            bestPrintf = elapsed;
+        }
+
+        start = nowSeconds();
+        Writer writer;
+        initWriter(&writer, sink);
+        for (int i = 0; i < count; i++) {
+            writeNumber(&writer, numbers[i]);
+            writeChar(&writer, '\n');
+        }
+        flushWriter(&writer);
+        elapsed = nowSeconds() - start;
+        if (bestWriter < 0 || elapsed < bestWriter) {
+            bestWriter = elapsed;
+        }
+    }
+
+    printf("%d numbers, output identical\n", count);
+    printf("fprintf %%g:    %6.1f ns/number\n", bestPrintf * 1e9 / count);
+    printf("Writer:        %6.1f ns/number (%.2fx)\n", bestWriter * 1e9 / count, bestPrintf / bestWriter);
+    fclose(sink);
+    free(numbers);
+    return 0;
+}
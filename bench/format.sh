@@ -0,0 +1,18 @@
+#!/bin/sh
+# Measures how fast results get printed: fprintf("%g") per number against formatNumber
+# through a Writer. Builds bench/format.c against number.c and writer.c and prints each
+# one's best ns per number over RUNS passes. Run it through `make bench-format` from the
+# repo root.
+#
+# Knobs (environment): COUNT (numbers per pass), RUNS (passes).
+
+set -e
+
+COUNT=${COUNT:-1000000}
+RUNS=${RUNS:-5}
+
+BUILD=bench/build
+mkdir -p "$BUILD"
+
+gcc -O2 bench/format.c number.c writer.c -o "$BUILD/format"
+"$BUILD/format" "$COUNT" "$RUNS"
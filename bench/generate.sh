@@ -0,0 +1,19 @@
+#!/bin/sh
+# Generates the benchmark workloads from bench/workloads/*.awk into the directory given
+# (bench/suite.sh and bench/compare.sh both use these).
+
+set -e
+
+OUT=$1
+mkdir -p "$OUT"
+
+generate() {
+    name=$1
+    shift
+    awk "$@" -f "bench/workloads/$name.awk" > "$OUT/$name.lox"
+}
+
+generate deep_arith -v depth=200 -v terms=5000
+generate string_concat -v terms=8000
+generate literals -v lines=200000
+generate comparisons -v terms=200000
@@ -0,0 +1,82 @@
+// Lexer throughput: scans a file to the end over and over and reports MB/s.
+// Built and run by bench/lexer.sh; not part of clox itself.
+//
+// Also prints a checksum over every token's type, length and line, so builds with and
+// without the vector fast paths can be checked against each other.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../scanner.h"
+
+static char* readWhole(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        exit(74);
+    }
+
+    fseek(file, 0L, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+
+    char* buffer = malloc(*size + 1);
+    if (buffer == NULL || fread(buffer, 1, *size, file) != *size) {
+        fprintf(stderr, "Could not read file \"%s\".\n", path);
+        exit(74);
+    }
+    buffer[*size] = '\0';
+
+    fclose(file);
+    return buffer;
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: lexer [path] [repeats]\n");
+        exit(64);
+    }
+
+    size_t size;
+    char* source = readWhole(argv[1], &size);
+    int repeats = atoi(argv[2]);
+
+    unsigned long tokens = 0;
+    unsigned long checksum = 0;
+    double best = -1;
+
+    for (int r = 0; r < repeats; r++) {
+        Scanner scanner;
+        initScanner(&scanner, source);
+
+        tokens = 0;
+        checksum = 0;
+
+        double start = nowSeconds();
+        for (;;) {
+            Token token = scanToken(&scanner);
+            tokens += 1;
+            checksum = checksum * 31 + (unsigned long) token.type * 1000003 + token.length * 131 + token.line;
+            if (token.type == TOKEN_EOF) {
+                break;
+            }
+        }
+        double elapsed = nowSeconds() - start;
+
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    printf("%8.1f MB/s  (%lu tokens, checksum %016lx)\n", size / best / 1e6, tokens, checksum);
+
+    free(source);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Measures scanner throughput with and without the vector fast paths in simdscan.c.
+#
+# Builds bench/lexer.c against the scanner three ways (plain loops, SSE2, and AVX2 when
+# the CPU has it), generates a source file heavy on whitespace, comments, strings and
+# numbers, and prints each build's best MB/s over RUNS passes. The token checksums
+# should all match. Run it through `make bench-lexer` from the repo root.
+#
+# Knobs (environment): LINES (lines of generated source), RUNS (passes per build).
+
+set -e
+
+LINES=${LINES:-200000}
+RUNS=${RUNS:-10}
+
+BUILD=bench/build
+mkdir -p "$BUILD"
+
+variants="scalar sse2"
+if grep -q avx2 /proc/cpuinfo 2>/dev/null; then
+    variants="$variants avx2"
+fi
+
+for variant in $variants; do
+    case $variant in
+        scalar) flags="-DCLOX_NO_SIMD" ;;
+        sse2) flags="" ;;
+        avx2) flags="-mavx2" ;;
+    esac
+    gcc -O2 $flags bench/lexer.c scanner.c simdscan.c -o "$BUILD/lexer-$variant"
+done
+
+# indented lines of arithmetic on long-ish numbers and strings, with trailing comments
+# and the odd block of comment lines and blank lines between them
+source="$BUILD/lexer_input.lox"
+awk -v lines="$LINES" 'BEGIN {
+    srand(7);
+    for (i = 0; i < lines; i++) {
+        if (i % 10 == 0) {
+            printf "\n    // ---------------------------------------------------------------- section %d\n", i;
+            printf "    // notes about the next few lines, long enough to take a few vector steps\n\n";
+        }
+        printf "        (%d.%06d + \"a string literal with some words in it %d\") ", int(rand() * 1000000), int(rand() * 1000000), i;
+        printf "* %d    // trailing comment on line %d\n", int(rand() * 100000000), i;
+    }
+}' > "$source"
+
+echo "input: $source ($(wc -c < "$source") bytes)"
+
+for variant in $variants; do
+    printf "%-7s" "$variant:"
+    "$BUILD/lexer-$variant" "$source" "$RUNS"
+done
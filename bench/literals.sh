@@ -0,0 +1,73 @@
+#!/bin/sh
+# Compile throughput on number-literal-heavy source, with literals read by parseNumber (the
+# default) against strtod (-DCLOX_STRTOD). Run it through `make bench-literals` from the
+# repo root.
+#
+# Three files: the suite's literals workload (short integers and decimals), decimals
+# printed with 17 significant digits (too many for the exact fast path), and long integers
+# and fractions (past 19 digits). Each is compiled by both builds to .loxc and the two must
+# be byte for byte the same, so every literal has to have come out bit-identical.
+# Throughput is source bytes over the median compile time --stats reports, with --no-fold
+# so there's nothing to fold.
+#
+# Knobs (environment): LINES (lines per file), RUNS (runs per build per file).
+
+set -e
+
+LINES=${LINES:-20000}
+RUNS=${RUNS:-11}
+
+BUILD=bench/build
+FILES="$BUILD/literals"
+mkdir -p "$FILES"
+
+. bench/median.sh
+
+gcc -O2 -DCLOX_STRTOD *.c -o "$BUILD/clox-strtod" -pthread
+gcc -O2 *.c -o "$BUILD/clox-parse" -pthread
+
+awk -v lines="$LINES" -f bench/workloads/literals.awk > "$FILES/short.lox"
+awk -v lines="$LINES" 'BEGIN {
+    srand(23);
+    for (l = 0; l < lines; l++) {
+        if (l > 0) printf " +\n";
+        printf "%.17g + %.16f + %.17g", rand() * 1000, rand(), rand() * 1e15;
+    }
+    printf "\n";
+}' | sed 's/e+\{0,1\}[-0-9]*//g' > "$FILES/seventeen.lox"
+awk -v lines="$LINES" 'BEGIN {
+    srand(29);
+    for (l = 0; l < lines; l++) {
+        if (l > 0) printf " +\n";
+        for (d = 0; d < 24; d++) printf "%d", (d == 0 ? 1 : 0) + int(rand() * (d == 0 ? 9 : 10));
+        printf " + 0.";
+        for (d = 0; d < 30; d++) printf "%d", int(rand() * 10);
+        printf "\n";
+    }
+}' > "$FILES/long.lox"
+
+printf "%-10s %10s %14s %14s %8s\n" file bytes "strtod MB/s" "parse MB/s" speedup
+
+for name in short seventeen long; do
+    source="$FILES/$name.lox"
+    "$BUILD/clox-strtod" --no-fold --compile "$source" -o "$FILES/$name-strtod.loxc"
+    "$BUILD/clox-parse" --no-fold --compile "$source" -o "$FILES/$name-parse.loxc"
+    if ! cmp -s "$FILES/$name-strtod.loxc" "$FILES/$name-parse.loxc"; then
+        echo "$name: parseNumber and strtod disagree on some literal" >&2
+        exit 1
+    fi
+
+    for build in strtod parse; do
+        stats="$BUILD/literals-$build.stats"
+        : > "$stats"
+        for run in $(seq "$RUNS"); do
+            "$BUILD/clox-$build" --stats --no-fold "$source" > /dev/null 2>> "$stats"
+        done
+        eval "${build}_ns=\$(sed -n 's/.*\"compile_ns\": \([0-9]*\).*/\1/p' \"\$stats\" | median)"
+    done
+
+    bytes=$(wc -c < "$source")
+    awk -v name="$name" -v bytes="$bytes" -v slow="$strtod_ns" -v fast="$parse_ns" 'BEGIN {
+        printf "%-10s %10d %14.1f %14.1f %7.2fx\n", name, bytes, bytes / slow * 1e3, bytes / fast * 1e3, slow / fast;
+    }'
+done
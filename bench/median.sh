@@ -0,0 +1,6 @@
+# sourced by the bench scripts
+
+# median of the numbers on stdin, one per line
+median() {
+    sort -n | awk '{ v[NR] = $1 } END { print (NR % 2) ? v[(NR + 1) / 2] : int((v[NR / 2] + v[NR / 2 + 1]) / 2) }'
+}
@@ -0,0 +1,71 @@
+#!/bin/sh
+# End-to-end benchmark suite. Run it through `make bench` from the repo root, which builds
+# the binary first; CLOX (environment) names the binary to measure.
+#
+# Each workload is generated from bench/workloads/*.awk, then run RUNS times with --stats.
+# Prints one JSON object per workload (and also writes them to bench/build/results.jsonl)
+# with the median wall time, median run time, instructions executed, instructions per
+# second of run time, and peak RSS, so results from two commits can be diffed directly.
+#
+# Most workloads run twice: as is, where the compiler folds nearly everything and the
+# time is mostly compiling, and with --no-fold, which leaves all the work to the VM.
+#
+# Knobs (environment): CLOX (binary), RUNS (runs per workload, default 5).
+
+set -e
+
+CLOX=${CLOX:-./clox}
+RUNS=${RUNS:-5}
+
+BUILD=bench/build
+SUITE="$BUILD/suite"
+RESULTS="$BUILD/results.jsonl"
+mkdir -p "$SUITE"
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+
+sh bench/generate.sh "$SUITE"
+
+. bench/median.sh
+
+# bench <workload> <label> [clox flags...]
+bench() {
+    name=$1
+    label=$2
+    shift 2
+    script="$SUITE/$name.lox"
+    stats="$SUITE/$label.stats"
+    : > "$stats"
+
+    walls=""
+    for run in $(seq "$RUNS"); do
+        start=$(date +%s%N)
+        "$CLOX" --stats "$@" "$script" > /dev/null 2>> "$stats"
+        end=$(date +%s%N)
+        walls="$walls $(( end - start ))"
+    done
+
+    wall=$(echo $walls | tr ' ' '\n' | median)
+    run_ns=$(sed -n 's/.*"run_ns": \([0-9]*\).*/\1/p' "$stats" | median)
+    instructions=$(sed -n 's/.*"instructions": \([0-9]*\).*/\1/p' "$stats" | tail -n 1)
+    rss=$(sed -n 's/.*"max_rss_kb": \([0-9]*\).*/\1/p' "$stats" | sort -n | tail -n 1)
+
+    awk -v commit="$commit" -v label="$label" -v flags="$*" -v bytes="$(wc -c < "$script")" -v runs="$RUNS" \
+        -v wall="$wall" -v run_ns="$run_ns" -v instructions="$instructions" -v rss="$rss" 'BEGIN {
+        ips = run_ns > 0 ? instructions / (run_ns / 1e9) : 0;
+        printf "{\"commit\": \"%s\", \"workload\": \"%s\", \"flags\": \"%s\", \"bytes\": %d, \"runs\": %d, ", commit, label, flags, bytes, runs;
+        printf "\"median_wall_ms\": %.3f, \"median_run_ms\": %.3f, \"instructions\": %d, ", wall / 1e6, run_ns / 1e6, instructions;
+        printf "\"instructions_per_sec\": %.0f, \"max_rss_kb\": %d}\n", ips, rss;
+    }' | tee -a "$RESULTS"
+}
+
+: > "$RESULTS"
+
+bench deep_arith deep_arith
+bench deep_arith deep_arith-nofold --no-fold
+bench string_concat string_concat
+bench string_concat string_concat-nofold --no-fold
+bench literals literals
+bench literals literals-nofold --no-fold
+bench comparisons comparisons
+bench comparisons comparisons-nofold --no-fold
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Compares the two Value layouts (tagged struct vs NaN boxing) on stack-heavy expressions.
+#
+# Builds an optimized binary for each layout, generates an expression
+# that keeps the VM stack deep (nested right-associated operators), and times each binary
+# on it a few times. Run it through `make bench-values` from the repo root.
+#
+# Knobs (environment): DEPTH (nesting per term, < 256), TERMS (terms in the outer chain),
+# RUNS (timed runs per layout).
+
+set -e
+
+DEPTH=${DEPTH:-200}
+TERMS=${TERMS:-2000}
+RUNS=${RUNS:-5}
+
+BUILD=bench/build
+mkdir -p "$BUILD"
+
+for layout in struct nanbox; do
+    flags="-O2 -DCLOX_COMPUTED_GOTO"
+    if [ "$layout" = nanbox ]; then
+        flags="$flags -DNAN_BOXING"
+    fi
+    gcc $flags *.c -o "$BUILD/clox-$layout" -pthread
+done
+
+# (1 + (2 + (3 + ... ))) * (...) - (...) ... every term pushes DEPTH values before reducing
+script="$BUILD/stack_heavy.lox"
+awk -v depth="$DEPTH" -v terms="$TERMS" 'BEGIN {
+    split("+ - *", ops, " ");
+    for (t = 0; t < terms; t++) {
+        if (t > 0) printf " %s\n", ops[t % 3 + 1];
+        for (d = 1; d < depth; d++) printf "(%d + ", d;
+        printf "%d", depth;
+        for (d = 1; d < depth; d++) printf ")";
+    }
+    printf "\n";
+}' > "$script"
+
+echo "script: $script ($(wc -c < "$script") bytes, depth $DEPTH, $TERMS terms)"
+
+for layout in struct nanbox; do
+    best=""
+    for run in $(seq "$RUNS"); do
+        start=$(date +%s%N)
+        "$BUILD/clox-$layout" "$script" > /dev/null
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "$layout: best of $RUNS runs: ${best} ms"
+done
@@ -0,0 +1,10 @@
+# Comparison-heavy: `terms` comparisons and negated comparisons chained with ==, e.g.
+# (1 < 2) == !(3 >= 4) == ..., all on booleans after the first level.
+BEGIN {
+    split("< <= > >=", ops, " ");
+    for (t = 0; t < terms; t++) {
+        if (t > 0) printf (t % 4 == 0) ? " ==\n" : " == ";
+        printf "%s(%d %s %d)", (t % 3 == 0) ? "!" : "", t % 17, ops[t % 4 + 1], t % 13;
+    }
+    printf "\n";
+}
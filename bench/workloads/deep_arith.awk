@@ -0,0 +1,12 @@
+# Deep arithmetic: `terms` parenthesized terms, each nested `depth` deep and right-associated,
+# so the VM stack climbs to depth before anything reduces. depth must stay under 256.
+BEGIN {
+    split("+ - *", ops, " ");
+    for (t = 0; t < terms; t++) {
+        if (t > 0) printf " %s\n", ops[t % 3 + 1];
+        for (d = 1; d < depth; d++) printf "(%d %s ", d, ops[d % 2 + 1];
+        printf "%d", depth;
+        for (d = 1; d < depth; d++) printf ")";
+    }
+    printf "\n";
+}
@@ -0,0 +1,11 @@
+# Large literal-heavy file: `lines` lines of sums of number literals (integers and
+# decimals, some repeated, some not), so most of the time goes to scanning, parsing
+# numbers and building the constant pool.
+BEGIN {
+    srand(12345);
+    for (l = 0; l < lines; l++) {
+        if (l > 0) printf " +\n";
+        printf "%d + %d.%d + %d + %d.5", l, int(rand() * 100000), int(rand() * 1000), l % 100, int(rand() * 10000);
+    }
+    printf "\n";
+}
@@ -0,0 +1,9 @@
+# Long string concatenation chain: "w0" + "w1" + ... with `terms` short literals, a few
+# words per line. Every + copies the whole left side, so this is quadratic in terms.
+BEGIN {
+    for (t = 0; t < terms; t++) {
+        if (t > 0) printf (t % 8 == 0) ? " +\n" : " + ";
+        printf "\"w%d\"", t % 1000;
+    }
+    printf "\n";
+}
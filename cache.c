@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "compiler.h"
+#include "memory.h"
+#include "object.h"
+#include "serialize.h"
+#include "vm.h"
+
+// grow the buckets once there are this many entries per bucket
+#define CACHE_MAX_LOAD 0.75
+
+void initChunkCache(ChunkCache* cache) {
+    cache->capacity = 0;
+    cache->bytes = 0;
+    cache->count = 0;
+    cache->bucketCount = 0;
+    cache->buckets = NULL;
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->directory = NULL;
+    memset(&cache->stats, 0, sizeof(cache->stats));
+}
+
+static void freeEntry(CacheEntry* entry) {
+    freeChunk(&entry->chunk);
+    FREE_ARRAY(MEM_CACHE, CacheEntry, entry, 1);
+}
+
+void freeChunkCache(ChunkCache* cache) {
+    CacheEntry* entry = cache->newest;
+    while (entry != NULL) {
+        CacheEntry* older = entry->older;
+        freeEntry(entry);
+        entry = older;
+    }
+    FREE_ARRAY(MEM_CACHE, CacheEntry*, cache->buckets, cache->bucketCount);
+
+    // the settings outlive a reset; only the contents and counters go
+    size_t capacity = cache->capacity;
+    const char* directory = cache->directory;
+    initChunkCache(cache);
+    cache->capacity = capacity;
+    cache->directory = directory;
+}
+
+bool cacheEnabled(ChunkCache* cache) {
+    return cache->capacity > 0 || cache->directory != NULL;
+}
+
+// Everything that decides what compile() makes of source goes into the key, so a chunk is
+// only ever reused under the settings it was compiled with. The .loxc version covers the
+// meaning of the bytecode itself
+static void cacheKey(VM* vm, const char* source, uint8_t key[SHA256_DIGEST_SIZE]) {
+    uint8_t settings[] = {
+        LOXC_VERSION,
+        vm->foldConstants,
+        vm->fuseInstructions,
+    };
+
+    Sha256 sha;
+    initSha256(&sha);
+    updateSha256(&sha, LOXC_MAGIC, strlen(LOXC_MAGIC));
+    updateSha256(&sha, settings, sizeof(settings));
+    updateSha256(&sha, source, strlen(source));
+    finishSha256(&sha, key);
+}
+
+// the key is already a uniform hash, so any 32 bits of it do
+static uint32_t bucketOf(ChunkCache* cache, const uint8_t key[SHA256_DIGEST_SIZE]) {
+    uint32_t hash;
+    memcpy(&hash, key, sizeof(hash));
+    return hash & (cache->bucketCount - 1);
+}
+
+static CacheEntry* findEntry(ChunkCache* cache, const uint8_t key[SHA256_DIGEST_SIZE]) {
+    if (cache->count == 0) {
+        return NULL;
+    }
+
+    for (CacheEntry* entry = cache->buckets[bucketOf(cache, key)]; entry != NULL; entry = entry->chained) {
+        if (memcmp(entry->key, key, SHA256_DIGEST_SIZE) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void growBuckets(ChunkCache* cache) {
+    int oldCount = cache->bucketCount;
+    CacheEntry** oldBuckets = cache->buckets;
+
+    cache->bucketCount = GROW_CAPACITY(oldCount);
+    cache->buckets = ALLOCATE(MEM_CACHE, CacheEntry*, cache->bucketCount);
+    for (int i = 0; i < cache->bucketCount; i++) {
+        cache->buckets[i] = NULL;
+    }
+
+    for (int i = 0; i < oldCount; i++) {
+        CacheEntry* entry = oldBuckets[i];
+        while (entry != NULL) {
+            CacheEntry* next = entry->chained;
+            uint32_t bucket = bucketOf(cache, entry->key);
+            entry->chained = cache->buckets[bucket];
+            cache->buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    FREE_ARRAY(MEM_CACHE, CacheEntry*, oldBuckets, oldCount);
+}
+
+static void unlinkRecency(ChunkCache* cache, CacheEntry* entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+}
+
+static void linkNewest(ChunkCache* cache, CacheEntry* entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL) {
+        cache->newest->newer = entry;
+    } else {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+static void removeEntry(ChunkCache* cache, CacheEntry* entry) {
+    CacheEntry** link = &cache->buckets[bucketOf(cache, entry->key)];
+    while (*link != entry) {
+        link = &(*link)->chained;
+    }
+    *link = entry->chained;
+
+    unlinkRecency(cache, entry);
+    cache->bytes -= entry->bytes;
+    cache->count--;
+    freeEntry(entry);
+}
+
+// Roughly what keeping the chunk costs: its arrays (or the mapping they live in, for one
+// loaded from a file) and the string constants it keeps alive. Strings shared between
+// chunks are counted for each of them
+static size_t entryBytes(CacheEntry* entry) {
+    Chunk* chunk = &entry->chunk;
+    size_t bytes = sizeof(CacheEntry)
+        + chunk->constants.capacity * sizeof(Value)
+        + chunk->constantIndex.capacity * sizeof(int);
+
+    if (chunk->image != NULL) {
+        bytes += chunk->image->size;
+    } else {
+        bytes += chunk->capacity + chunk->lines.capacity * sizeof(LineRecord);
+    }
+
+    for (int i = 0; i < chunk->constants.count; i++) {
+        if (IS_STRING(chunk->constants.values[i])) {
+            bytes += stringSize(AS_STRING(chunk->constants.values[i])->length);
+        }
+    }
+    return bytes;
+}
+
+// makes entry the newest, then drops the oldest ones until the rest fit
+static void insertEntry(ChunkCache* cache, CacheEntry* entry) {
+    if (cache->count + 1 > cache->bucketCount * CACHE_MAX_LOAD) {
+        growBuckets(cache);
+    }
+
+    uint32_t bucket = bucketOf(cache, entry->key);
+    entry->chained = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    linkNewest(cache, entry);
+
+    entry->bytes = entryBytes(entry);
+    cache->bytes += entry->bytes;
+    cache->count++;
+
+    while (cache->bytes > cache->capacity && cache->oldest != entry) {
+        removeEntry(cache, cache->oldest);
+        cache->stats.evictions++;
+    }
+}
+
+// where the chunk for key lives in the directory: <directory>/<key in hex>.loxc
+static void entryPath(ChunkCache* cache, const uint8_t key[SHA256_DIGEST_SIZE], char* path, size_t size) {
+    char hex[SHA256_DIGEST_SIZE * 2 + 1];
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        snprintf(hex + i * 2, 3, "%02x", key[i]);
+    }
+    snprintf(path, size, "%s/%s.loxc", cache->directory, hex);
+}
+
+// A file that's missing, or won't load (truncated, or written by an incompatible build),
+// is just a miss; compiling again overwrites it
+static bool loadFromDirectory(VM* vm, ChunkCache* cache, CacheEntry* entry) {
+    size_t size = strlen(cache->directory) + SHA256_DIGEST_SIZE * 2 + 8;
+    char* path = ALLOCATE(MEM_CACHE, char, size);
+    entryPath(cache, entry->key, path, size);
+
+    struct stat info;
+    bool loaded = stat(path, &info) == 0 && loadChunk(vm, path, &entry->chunk, NULL);
+
+    FREE_ARRAY(MEM_CACHE, char, path, size);
+    return loaded;
+}
+
+// Written under a name of its own and renamed into place, so other threads and processes
+// sharing the directory never see half a file
+static void saveToDirectory(ChunkCache* cache, CacheEntry* entry) {
+    size_t size = strlen(cache->directory) + SHA256_DIGEST_SIZE * 2 + 8;
+    char* path = ALLOCATE(MEM_CACHE, char, size);
+    entryPath(cache, entry->key, path, size);
+
+    size_t temporarySize = size + 64;
+    char* temporary = ALLOCATE(MEM_CACHE, char, temporarySize);
+    snprintf(temporary, temporarySize, "%s.%ld.%p", path, (long) getpid(), (void*) entry);
+
+    if (saveChunk(&entry->chunk, temporary)) {
+        if (rename(temporary, path) == 0) {
+            cache->stats.diskWrites++;
+        } else {
+            remove(temporary);
+        }
+    }
+
+    FREE_ARRAY(MEM_CACHE, char, temporary, temporarySize);
+    FREE_ARRAY(MEM_CACHE, char, path, size);
+}
+
+Chunk* compileCached(VM* vm, const char* source) {
+    ChunkCache* cache = &vm->cache;
+
+    uint8_t key[SHA256_DIGEST_SIZE];
+    cacheKey(vm, source, key);
+
+    CacheEntry* entry = findEntry(cache, key);
+    if (entry != NULL) {
+        cache->stats.hits++;
+        unlinkRecency(cache, entry);
+        linkNewest(cache, entry);
+        return &entry->chunk;
+    }
+
+    entry = ALLOCATE(MEM_CACHE, CacheEntry, 1);
+    memcpy(entry->key, key, SHA256_DIGEST_SIZE);
+    initChunk(&entry->chunk);
+
+    if (cache->directory != NULL && loadFromDirectory(vm, cache, entry)) {
+        cache->stats.diskHits++;
+    } else {
+        cache->stats.misses++;
+
+        // rooted while compiling, like interpret()'s own chunk; the cached ones are already
+        Chunk* previousChunk = vm->chunk;
+        vm->chunk = &entry->chunk;
+        bool compiled = compile(vm, source, &entry->chunk);
+        vm->chunk = previousChunk;
+
+        if (!compiled) {
+            freeEntry(entry);
+            return NULL;
+        }
+        if (cache->directory != NULL) {
+            saveToDirectory(cache, entry);
+        }
+    }
+
+    insertEntry(cache, entry);
+    return &entry->chunk;
+}
+
+bool evictIdleChunks(VM* vm, ChunkCache* cache) {
+    bool evicted = false;
+    CacheEntry* entry = cache->oldest;
+    while (entry != NULL) {
+        CacheEntry* newer = entry->newer;
+        if (&entry->chunk != vm->chunk) {
+            removeEntry(cache, entry);
+            cache->stats.evictions++;
+            evicted = true;
+        }
+        entry = newer;
+    }
+    return evicted;
+}
+
+void markChunkCache(VM* vm, ChunkCache* cache) {
+    for (CacheEntry* entry = cache->newest; entry != NULL; entry = entry->older) {
+        markArray(vm, &entry->chunk.constants);
+    }
+}
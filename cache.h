@@ -0,0 +1,79 @@
+#ifndef clox_cache_h
+#define clox_cache_h
+
+#include "chunk.h"
+#include "sha256.h"
+
+typedef struct VM VM;
+
+// the cache's capacity for the REPL and --batch when none is given; see --cache-size
+#define DEFAULT_CACHE_BYTES (16 * 1024 * 1024)
+
+typedef struct {
+    // lookups answered from memory, from the directory, or compiled from scratch
+    uint64_t hits;
+    uint64_t diskHits;
+    uint64_t misses;
+    // chunks dropped from memory to stay within the capacity
+    uint64_t evictions;
+    // chunks written to the directory
+    uint64_t diskWrites;
+} CacheStats;
+
+typedef struct CacheEntry {
+    // SHA-256 of the compiler settings and the source; see cacheKey in cache.c
+    uint8_t key[SHA256_DIGEST_SIZE];
+    Chunk chunk;
+    // what this entry counts against the capacity
+    size_t bytes;
+    // the recency list, most recently used first
+    struct CacheEntry* newer;
+    struct CacheEntry* older;
+    // the next entry in the same bucket
+    struct CacheEntry* chained;
+} CacheEntry;
+
+// Compiled chunks by the content they were compiled from, so the same source is only
+// compiled once. Kept in memory up to capacity bytes, least recently used out first, and
+// optionally in a directory of .loxc files (named by their key) that outlives the process.
+// A cache belongs to one VM, since the chunks' string constants do; their constants are
+// GC roots for as long as they're cached.
+typedef struct {
+    // bytes the cached chunks may take up; the most recently used one always stays, even
+    // if it's bigger on its own. 0 only keeps that one
+    size_t capacity;
+    size_t bytes;
+    int count;
+    // indexed by the low bits of the key; zero or a power of two of them
+    int bucketCount;
+    CacheEntry** buckets;
+    CacheEntry* newest;
+    CacheEntry* oldest;
+    // where the .loxc files go, or NULL to keep it all in memory
+    const char* directory;
+    CacheStats stats;
+} ChunkCache;
+
+void initChunkCache(ChunkCache* cache);
+void freeChunkCache(ChunkCache* cache);
+
+// whether interpret() goes through the cache at all: it's off until given a capacity or
+// a directory
+bool cacheEnabled(ChunkCache* cache);
+
+// The compiled chunk for source under vm's compiler settings: from memory or the directory
+// if it's been compiled before, and compiled (and cached) if not. Returns NULL on a compile
+// error, which is never cached, since the errors have to be reported every time. The chunk
+// belongs to the cache, and stays valid until the next call
+Chunk* compileCached(VM* vm, const char* source);
+
+// Drops every cached chunk but the one in vm->chunk, so the constants only they kept alive
+// can be collected. For when the heap is over vm->heapLimit: it keeps what fits from
+// depending on which scripts this VM happened to run before. Returns false if there
+// was nothing to drop
+bool evictIdleChunks(VM* vm, ChunkCache* cache);
+
+// marks the constants of every cached chunk; see markRoots
+void markChunkCache(VM* vm, ChunkCache* cache);
+
+#endif
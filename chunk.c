@@ -1,8 +1,134 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "chunk.h"
 #include "memory.h"
 #include "lines.h"
+#include "object.h"
+
+// grow the index once it's this full
+#define CONSTANT_INDEX_MAX_LOAD 0.75
+
+static void initConstantIndex(ConstantIndex* index) {
+    index->count = 0;
+    index->capacity = 0;
+    index->slots = NULL;
+}
+
+static void freeConstantIndex(ConstantIndex* index) {
+    FREE_ARRAY(MEM_CONSTANTS, int, index->slots, index->capacity);
+    initConstantIndex(index);
+}
+
+// only numbers and strings end up in the pool, but everything hashes
+static uint32_t hashConstant(Value value) {
+    if (IS_NUMBER(value)) {
+        double number = AS_NUMBER(value);
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        // fold the high bits in; plenty of small integers only differ up there
+        bits ^= bits >> 33;
+        bits *= 0xff51afd7ed558ccdull;
+        bits ^= bits >> 33;
+        return (uint32_t) bits;
+    }
+
+    if (IS_OBJ(value)) {
+        return AS_STRING(value)->hash;
+    }
+
+    return IS_NIL(value) ? 1 : (AS_BOOL(value) ? 2 : 3);
+}
+
+// not valuesEqual: numbers are compared by their bits, so 0 and -0 stay apart
+// (they print differently) and a NaN can share a slot with itself
+static bool sameConstant(Value a, Value b) {
+    if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        double x = AS_NUMBER(a);
+        double y = AS_NUMBER(b);
+        return memcmp(&x, &y, sizeof(double)) == 0;
+    }
+
+    return !IS_NUMBER(a) && !IS_NUMBER(b) && valuesEqual(a, b);
+}
+
+// the slot holding value, or the empty slot it would go in
+static int findConstantSlot(ConstantIndex* index, ValueArray* constants, Value value) {
+    uint32_t slot = hashConstant(value) & (index->capacity - 1);
+    for (;;) {
+        int constant = index->slots[slot];
+        if (constant == -1 || sameConstant(constants->values[constant], value)) {
+            return slot;
+        }
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+}
+
+static void growConstantIndex(ConstantIndex* index, ValueArray* constants) {
+    int oldCapacity = index->capacity;
+    int* oldSlots = index->slots;
+
+    index->capacity = GROW_CAPACITY(oldCapacity);
+    index->slots = ALLOCATE(MEM_CONSTANTS, int, index->capacity);
+    for (int i = 0; i < index->capacity; i++) {
+        index->slots[i] = -1;
+    }
+
+    for (int i = 0; i < oldCapacity; i++) {
+        int constant = oldSlots[i];
+        if (constant != -1) {
+            index->slots[findConstantSlot(index, constants, constants->values[constant])] = constant;
+        }
+    }
+
+    FREE_ARRAY(MEM_CONSTANTS, int, oldSlots, oldCapacity);
+}
+
+// drop the given constant from the index. Linear probing lets us do this without
+// tombstones: shift later members of the probe run back over the gap instead
+static void removeFromConstantIndex(ConstantIndex* index, ValueArray* constants, int constant) {
+    int mask = index->capacity - 1;
+    int gap = findConstantSlot(index, constants, constants->values[constant]);
+    if (index->slots[gap] != constant) {
+        return;
+    }
+
+    index->slots[gap] = -1;
+    index->count -= 1;
+
+    for (int slot = (gap + 1) & mask; index->slots[slot] != -1; slot = (slot + 1) & mask) {
+        int moving = index->slots[slot];
+        int home = hashConstant(constants->values[moving]) & mask;
+
+        // an entry can move into the gap only if the gap lies on its probe path,
+        // i.e. cyclically between its home slot and where it is now
+        bool reachable = gap <= slot
+            ? (home <= gap || home > slot)
+            : (home <= gap && home > slot);
+
+        if (reachable) {
+            index->slots[gap] = moving;
+            index->slots[slot] = -1;
+            gap = slot;
+        }
+    }
+}
+
+int instructionLength(uint8_t opcode) {
+    switch (opcode) {
+        case OP_CONSTANT:
+        case OP_ADD_CONSTANT:
+        case OP_MULTIPLY_CONSTANT:
+        case OP_CONCAT:
+            return 2;
+
+        case OP_CONSTANT_LONG:
+            return 4;
+
+        default:
+            return opcode < OP_CODE_COUNT ? 1 : -1;
+    }
+}
 
 void initChunk(Chunk* chunk) {
     chunk->count = 0;
@@ -10,6 +136,10 @@ void initChunk(Chunk* chunk) {
     chunk->code = NULL;
     initLinesArray(&chunk->lines);
     initValueArray(&chunk->constants);
+    initConstantIndex(&chunk->constantIndex);
+    chunk->constantsDeduped = 0;
+    chunk->maxStack = -1;
+    chunk->image = NULL;
 }
 
 // Write a byte into the chunk
@@ -19,7 +149,7 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line) {
     if (chunk->capacity < chunk->count + 1) {
         int oldCapacity = chunk->capacity;
         chunk->capacity = GROW_CAPACITY(oldCapacity);
-        chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
+        chunk->code = GROW_ARRAY(MEM_CODE, uint8_t, chunk->code, oldCapacity, chunk->capacity);
     }
 
     chunk->code[chunk->count] = byte;
@@ -27,15 +157,76 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line) {
 }
 
 void freeChunk(Chunk* chunk) {
-    FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
-    freeLinesArray(&chunk->lines);
+    if (chunk->image != NULL) {
+        // code and lines are views into the image, which goes all at once
+        unmapFile(chunk->image);
+        free(chunk->image);
+    } else {
+        FREE_ARRAY(MEM_CODE, uint8_t, chunk->code, chunk->capacity);
+        freeLinesArray(&chunk->lines);
+    }
     freeValueArray(&chunk->constants);
+    freeConstantIndex(&chunk->constantIndex);
     initChunk(chunk);
 }
 
-void writeConstant(Chunk* chunk, Value value, int line) {
+void truncateCode(Chunk* chunk, int codeCount) {
+    chunk->count = codeCount;
+    truncateLinesArray(&chunk->lines, codeCount);
+}
+
+// how many of the instructions in code[from, to) load a constant, fused ones included
+static int countConstantLoads(Chunk* chunk, int from, int to) {
+    int loads = 0;
+    for (int offset = from; offset < to; offset += instructionLength(chunk->code[offset])) {
+        switch (chunk->code[offset]) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG:
+            case OP_ADD_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+                loads++;
+                break;
+        }
+    }
+    return loads;
+}
+
+void truncateChunk(Chunk* chunk, int codeCount, int constantCount) {
+    // each dropped constant was added by one of the dropped loads; the rest of those
+    // loads reused a constant, and no longer count as saving anything
+    int loads = countConstantLoads(chunk, codeCount, chunk->count);
+    chunk->constantsDeduped -= loads - (chunk->constants.count - constantCount);
+
+    truncateCode(chunk, codeCount);
+
+    // newest first, while their values are still in the pool for rehashing
+    for (int constant = chunk->constants.count - 1; constant >= constantCount; constant--) {
+        removeFromConstantIndex(&chunk->constantIndex, &chunk->constants, constant);
+    }
+    chunk->constants.count = constantCount;
+}
+
+// returns the pool index of value, adding it first if it isn't there yet
+static int addConstant(Chunk* chunk, Value value) {
+    ConstantIndex* index = &chunk->constantIndex;
+    if (index->count + 1 > index->capacity * CONSTANT_INDEX_MAX_LOAD) {
+        growConstantIndex(index, &chunk->constants);
+    }
+
+    int slot = findConstantSlot(index, &chunk->constants, value);
+    if (index->slots[slot] != -1) {
+        chunk->constantsDeduped += 1;
+        return index->slots[slot];
+    }
+
     writeValueArray(&chunk->constants, value);
-    int valueIdx = chunk->constants.count - 1;
+    index->slots[slot] = chunk->constants.count - 1;
+    index->count += 1;
+    return chunk->constants.count - 1;
+}
+
+void writeConstant(Chunk* chunk, Value value, int line) {
+    int valueIdx = addConstant(chunk, value);
     if (valueIdx < (1 << 8)) {
         writeChunk(chunk, OP_CONSTANT, line);
         writeChunk(chunk, valueIdx & (0xFF), line);
@@ -4,6 +4,7 @@
 #include "common.h"
 #include "value.h"
 #include "lines.h"
+#include "mapfile.h"
 
 typedef enum {
     OP_CONSTANT,
@@ -24,19 +25,71 @@ typedef enum {
     OP_NOT,
     OP_NEGATE,
     OP_RETURN,
+
+    // superinstructions: fused forms of pairs that come up constantly (see --opcode-pairs).
+    // Each behaves exactly like the pair it replaces, errors included.
+    // OP_CONSTANT idx; OP_ADD         (1-byte constant index operand)
+    OP_ADD_CONSTANT,
+    // OP_CONSTANT idx; OP_MULTIPLY    (1-byte constant index operand)
+    OP_MULTIPLY_CONSTANT,
+    // a comparison followed by OP_NOT. These can't turn into the opposite comparison,
+    // since every comparison involving NaN is false
+    OP_NOT_GREATER,
+    OP_NOT_GREATER_EQUAL,
+    OP_NOT_LESS,
+    OP_NOT_LESS_EQUAL,
+    // n operands (1-byte operand, at least 2) added up left to right, exactly as n - 1
+    // OP_ADDs in a row would: for a chain of + that all ends up on one line
+    OP_CONCAT,
+
+    // not an instruction; the number of OP_CODEs
+    OP_CODE_COUNT,
 } OP_CODE;
 
+// hash index over a chunk's constant pool, so writeConstant can reuse the slot of a
+// value that's already in there. Open addressing with linear probing.
+typedef struct {
+    // number of occupied slots
+    int count;
+    // zero or a power of two
+    int capacity;
+    // index into the constant pool, or -1 if the slot is empty
+    int* slots;
+} ConstantIndex;
+
 typedef struct {
     int count;
     int capacity;
     uint8_t* code;
     LineRecordArray lines;
     ValueArray constants;
+    ConstantIndex constantIndex;
+    // how many of the loads in the code reuse an existing constant instead of adding one
+    int constantsDeduped;
+    // the deepest the stack gets running this chunk; -1 until verifyChunk has passed it
+    int maxStack;
+    // set if the chunk was loaded from a .loxc file; code and lines.records then point
+    // into this mapping instead of being allocated, and can't be written to
+    MappedFile* image;
 } Chunk;
 
+// total size in bytes (opcode and operands) of an instruction with the given opcode,
+// or -1 if it isn't an opcode
+int instructionLength(uint8_t opcode);
+
 void initChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
 void freeChunk(Chunk* chunk);
+// emits a load of value, adding it to the constant pool unless an identical
+// constant is already there: the same bits for numbers, the same object for strings
 void writeConstant(Chunk* chunk, Value value, int line);
 
+// drops the code from codeCount on (and its lines), leaving the constants alone; for code
+// that's about to be emitted again, loads and all
+void truncateCode(Chunk* chunk, int codeCount);
+// drops the code from codeCount on (and its lines), and the constants from constantCount on,
+// taking the dropped code's loads out of constantsDeduped.
+// The dropped constants must not be referred to by any of the code that's left.
+void truncateChunk(Chunk* chunk, int codeCount, int constantCount);
+
 #endif
\ No newline at end of file
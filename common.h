@@ -8,13 +8,18 @@
 #include <stdlib.h>
 #include <string.h>
 
-// comment this out to disable chunk dumping after a parse
-#define DEBUG_PRINT_CODE
+// define this (e.g. -DNAN_BOXING) to pack every Value into a single 64-bit word
+// instead of the tagged struct; see value.h
+// #define NAN_BOXING
 
-// comment this out to disable trace logs
-#define DEBUG_TRACE_EXECUTION
+// chunk dumps and execution traces are runtime options now (--dump-code, --trace,
+// --trace-stack), so there's nothing to switch on here for them
 
-// even for debug logs this is pretty chatty
-#define DEBUG_TRACE_EXECUTION_PRINT_STACK
+// collect garbage on every heap allocation instead of waiting for the threshold;
+// slow, but shakes out objects that aren't rooted when they should be
+// #define DEBUG_STRESS_GC
+
+// log every collection, and every object it marks or frees
+// #define DEBUG_LOG_GC
 
 #endif
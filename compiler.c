@@ -1,21 +1,78 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "common.h"
 #include "compiler.h"
 #include "scanner.h"
+#include "debug.h"
+#include "number.h"
+#include "verify.h"
+#include "vm.h"
 
-#ifdef DEBUG_PRINT_CODE
-    #include "debug.h"
-#endif
+// what an expression is known to evaluate to, if it evaluates without a runtime error
+typedef enum {
+    EXPR_ANY,
+    EXPR_NUMBER,
+    EXPR_BOOL,
+} ExprType;
+
+// for an expression compiled to OP_CONCAT: what its operands are known to be
+typedef enum {
+    // anything; adding them up might fail at runtime
+    CHAIN_ANY,
+    // every operand is a load of a constant string, or every one a load of a constant
+    // number, so the chain can't fail on its types (and can be folded whole). A string
+    // chain can still run out of memory (see VM.heapLimit); that's reported at the
+    // OP_CONCAT's line, not at the + whose string didn't fit
+    CHAIN_STRINGS,
+    CHAIN_NUMBERS,
+} ChainKind;
+
+// what the compiler knows about the bytecode of the expression it just compiled.
+// This is what constant folding works from: we're single pass, so instead of
+// folding a tree we fold the code that was just emitted, by truncating it.
+typedef struct {
+    // code offset where the expression's bytecode starts
+    int start;
+    // size of the constant pool before the expression was compiled;
+    // constants past this are only referred to by the expression's own code
+    int constantsStart;
+    // true if the expression's code is a single load of a known value
+    bool isConstant;
+    Value value;
+    ExprType type;
+    // the last OP_CODE emitted for the expression, or -1 if it's a constant
+    int rootOp;
+    // when rootOp is OP_CONCAT; see concatenation()
+    ChainKind chain;
+} ExprInfo;
 
 typedef struct {
     Token current;
     Token previous;
     bool hadError;
     bool panicMode;
+    // the expression most recently compiled
+    ExprInfo expr;
 } Parser;
 
+// everything one compile() works with. Nothing about a compilation lives outside of this,
+// so separate compilations (into separate chunks, with separate VMs) can run on separate
+// threads
+typedef struct {
+    Scanner scanner;
+    Parser parser;
+    // the chunk being compiled into
+    Chunk* chunk;
+    // owner of the string table that literals get interned into
+    VM* vm;
+    // fold constant subexpressions and simplify identities; see binary()
+    bool foldConstants;
+    // emit superinstructions for the pairs they replace
+    bool fuseInstructions;
+} Compiler;
+
 typedef enum {
     PREC_NONE,
     PREC_ASSIGNMENT,    // =
@@ -30,16 +87,15 @@ typedef enum {
     PREC_PRIMARY,
 } Precedence;
 
-// literally, a function that takes no arguments and returns nothing
-// TODO: probably alter this typedef? since we don't have global state
-typedef void (*ParseFn)(Scanner*, Parser*);
+// a parse function gets the whole compilation context, and returns nothing
+typedef void (*ParseFn)(Compiler*);
 
-static void number(Scanner* scanner, Parser* parser);
-static void string(Scanner* scanner, Parser* parser);
-static void unary(Scanner* scanner, Parser* parser);
-static void grouping(Scanner* scanner, Parser* parser);
-static void binary(Scanner* scanner, Parser* parser);
-static void literal(Scanner* scanner, Parser* parser);
+static void number(Compiler* compiler);
+static void string(Compiler* compiler);
+static void unary(Compiler* compiler);
+static void grouping(Compiler* compiler);
+static void binary(Compiler* compiler);
+static void literal(Compiler* compiler);
 
 // each token type has an associated parse rule
 typedef struct {
@@ -53,7 +109,7 @@ typedef struct {
     Precedence  precedence;
 } ParseRule;
 
-ParseRule rules[] = {
+static const ParseRule rules[] = {
     // key is the token; rhs is a struct literal -- prefix parse fn, infix parse fn, precedence
     // null is used when that structure is not relevant
     [TOKEN_LEFT_PAREN]      = { grouping,   NULL,   PREC_NONE   },
@@ -99,159 +155,274 @@ ParseRule rules[] = {
     [TOKEN_EOF]             = { NULL,       NULL,   PREC_NONE   },
 };
 
-static ParseRule* getRule(TokenType type) {
+static const ParseRule* getRule(TokenType type) {
     return &rules[type];
 }
 
-// TODO eliminate this global state, I don't understand it enough right now
-Chunk* compilingChunk;
-
-static Chunk* currentChunk() {
-    return compilingChunk;
+static Chunk* currentChunk(Compiler* compiler) {
+    return compiler->chunk;
 }
 
-static void errorAt(Parser* parser, Token* token, const char* message) {
+static void errorAt(Compiler* compiler, Token* token, const char* message) {
     // this prevents error cascades; report the first one and then just sort of squelch
     // obviously we need to periodically turn this off or you just get one error per compile
     // which might also be bad (??)
-    if (parser->panicMode) {
+    if (compiler->parser.panicMode) {
         return;
     }
-    parser->panicMode = true;
-
-    fprintf(stderr, "[line %d] Error", token->line);
+    compiler->parser.panicMode = true;
 
+    // each message is a single fprintf, so another thread writing to the same stream
+    // can't land in the middle of it
+    FILE* err = compiler->vm->err;
     if (token->type == TOKEN_EOF) {
-        fprintf(stderr, " at end");
+        fprintf(err, "[line %d] Error at end: %s\n", token->line, message);
     } else if (token->type == TOKEN_ERROR) {
         // no type to print, it's an error
+        fprintf(err, "[line %d] Error: %s\n", token->line, message);
     } else {
-        fprintf(stderr, " at '%.*s'", token->length, token->start);
+        fprintf(err, "[line %d] Error at '%.*s': %s\n", token->line, token->length, token->start, message);
     }
-
-    fprintf(stderr, ": %s\n", message);
-    parser->hadError = true;
+    compiler->parser.hadError = true;
 }
 
-static void error(Parser* parser, const char* message) {
-    errorAt(parser, &parser->previous, message);
+static void error(Compiler* compiler, const char* message) {
+    errorAt(compiler, &compiler->parser.previous, message);
 }
 
-static void errorAtCurrent(Parser* parser, const char* message) {
-    errorAt(parser, &parser->current, message);
+static void errorAtCurrent(Compiler* compiler, const char* message) {
+    errorAt(compiler, &compiler->parser.current, message);
 }
 
-static void advance(Scanner* scanner, Parser* parser) {
-    parser->previous = parser->current;
+static void advance(Compiler* compiler) {
+    compiler->parser.previous = compiler->parser.current;
 
     // this loop looks weird; it just means we keep looping through tokens
     // and reporting+skipping errors until we get a real one (which might be EOF)
     for (;;) {
-        parser->current = scanToken(scanner);
+        compiler->parser.current = scanToken(&compiler->scanner);
 
-        if (parser->current.type != TOKEN_ERROR) {
+        if (compiler->parser.current.type != TOKEN_ERROR) {
             break;
         }
 
-        errorAtCurrent(parser, parser->current.start);
+        errorAtCurrent(compiler, compiler->parser.current.start);
     }
 }
 
 // expect a given token type and consume it (advance); if we didn't get it, throw an error
-static void consume(Scanner* scanner, Parser* parser, TokenType type, const char* message) {
-    if (parser->current.type == type) {
-        advance(scanner, parser);
+static void consume(Compiler* compiler, TokenType type, const char* message) {
+    if (compiler->parser.current.type == type) {
+        advance(compiler);
         return;
     }
 
-    errorAtCurrent(parser, message);
+    errorAtCurrent(compiler, message);
 }
 
-static void emitByte(int lineNumber, uint8_t byte) {
-    writeChunk(currentChunk(), byte, lineNumber);
+static void emitByte(Compiler* compiler, int lineNumber, uint8_t byte) {
+    writeChunk(currentChunk(compiler), byte, lineNumber);
 }
 
-static void emitBytes(int lineNumber, uint8_t b1, uint8_t b2) {
-    emitByte(lineNumber, b1);
-    emitByte(lineNumber, b2);
+static void emitBytes(Compiler* compiler, int lineNumber, uint8_t b1, uint8_t b2) {
+    emitByte(compiler, lineNumber, b1);
+    emitByte(compiler, lineNumber, b2);
 }
 
-static void emitReturn(int lineNumber) {
-    emitByte(lineNumber, OP_RETURN);
+static void emitReturn(Compiler* compiler, int lineNumber) {
+    emitByte(compiler, lineNumber, OP_RETURN);
 }
 
-static void endCompiler(Parser* parser) {
-    int lineNumber = parser->previous.line;
-    emitReturn(lineNumber);
+static void endCompiler(Compiler* compiler) {
+    int lineNumber = compiler->parser.previous.line;
+    emitReturn(compiler, lineNumber);
 
-#ifdef DEBUG_PRINT_CODE
-    if (!parser->hadError) {
-        disassambleChunk(currentChunk(), "code");
+    if (compiler->vm->dumpCode) {
+        if (!compiler->parser.hadError) {
+            disassambleChunk(currentChunk(compiler), "code");
+        } else {
+            printf("Skipping chunk dump, since a parser error was found.\n");
+        }
+    }
+
+    if (!compiler->parser.hadError) {
+        int offset;
+        const char* problem = verifyChunk(currentChunk(compiler), &offset);
+        if (problem != NULL) {
+            // a compiler bug rather than anything wrong with the source
+            fprintf(compiler->vm->err, "Compiled invalid bytecode at %04d: %s.\n", offset, problem);
+            compiler->parser.hadError = true;
+        }
+    }
+}
+
+static void setConstantExpr(Compiler* compiler, Value value) {
+    compiler->parser.expr.isConstant = true;
+    compiler->parser.expr.value = value;
+    compiler->parser.expr.rootOp = -1;
+    compiler->parser.expr.chain = CHAIN_ANY;
+
+    if (IS_NUMBER(value)) {
+        compiler->parser.expr.type = EXPR_NUMBER;
+    } else if (IS_BOOL(value)) {
+        compiler->parser.expr.type = EXPR_BOOL;
     } else {
-        printf("Skipping chunk dump, since a parser error was found.\n");
+        compiler->parser.expr.type = EXPR_ANY;
     }
-#endif
+}
+
+static void setComputedExpr(Compiler* compiler, int rootOp, ExprType type) {
+    compiler->parser.expr.isConstant = false;
+    compiler->parser.expr.value = NIL_VAL;
+    compiler->parser.expr.type = type;
+    compiler->parser.expr.rootOp = rootOp;
+    compiler->parser.expr.chain = CHAIN_ANY;
 }
 
 // parse things at or above the given precedence
-static void parsePrecedence(Scanner* scanner, Parser* parser, Precedence precedence) {
-    advance(scanner, parser);
-    ParseFn prefixRule = getRule(parser->previous.type)->prefix;
+static void parsePrecedence(Compiler* compiler, Precedence precedence) {
+    // everything parsed here, prefix and infixes alike, is one expression starting at this point
+    int start = currentChunk(compiler)->count;
+    int constantsStart = currentChunk(compiler)->constants.count;
+
+    advance(compiler);
+    ParseFn prefixRule = getRule(compiler->parser.previous.type)->prefix;
     if (prefixRule == NULL) {
-        error(parser, "Expect expression.");
+        error(compiler, "Expect expression.");
         return;
     }
 
-    prefixRule(scanner, parser);
+    prefixRule(compiler);
+    compiler->parser.expr.start = start;
+    compiler->parser.expr.constantsStart = constantsStart;
 
-    while (precedence <= getRule(parser->current.type)->precedence) {
-        advance(scanner, parser);
-        ParseFn infixRule = getRule(parser->previous.type)->infix;
-        infixRule(scanner, parser);
+    while (precedence <= getRule(compiler->parser.current.type)->precedence) {
+        advance(compiler);
+        ParseFn infixRule = getRule(compiler->parser.previous.type)->infix;
+        infixRule(compiler);
+        compiler->parser.expr.start = start;
+        compiler->parser.expr.constantsStart = constantsStart;
     }
 }
 
-static void expression(Scanner* scanner, Parser* parser) {
-    parsePrecedence(scanner, parser, PREC_ASSIGNMENT);
+static void expression(Compiler* compiler) {
+    parsePrecedence(compiler, PREC_ASSIGNMENT);
 }
 
 // consume and output the rest of a parenthetized expression, given the start paren has been consumed
-static void grouping(Scanner* scanner, Parser* parser) {
-    expression(scanner, parser);
-    consume(scanner, parser, TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+static void grouping(Compiler* compiler) {
+    expression(compiler);
+    consume(compiler, TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+}
+
+// emit a constant to the chunk
+static void emitConstant(Compiler* compiler, int line, Value value) {
+    writeConstant(currentChunk(compiler), value, line);
 }
 
-// emit a constant to the chunk. Only uses parser for line number
-static void emitConstant(int line, Value value) {
-    writeConstant(currentChunk(), value, line);
+// emits whatever instruction loads the given value most cheaply
+static void emitValue(Compiler* compiler, int line, Value value) {
+    if (IS_NIL(value)) {
+        emitByte(compiler, line, OP_NIL);
+    } else if (IS_BOOL(value)) {
+        emitByte(compiler, line, AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+    } else {
+        emitConstant(compiler, line, value);
+    }
 }
 
-static void number(Scanner* scanner, Parser* parser) {
-    double value = strtod(parser->previous.start, NULL);
-    emitConstant(parser->previous.line, NUMBER_VAL(value));
+// throws away all the code (and constants) emitted for the expression described by expr,
+// so the caller can emit something equivalent in its place
+static void discardExpr(Compiler* compiler, ExprInfo* expr) {
+    truncateChunk(currentChunk(compiler), expr->start, expr->constantsStart);
 }
 
-// consume a string literal, given it's in the parser->previous token
-static void string(Scanner* scanner, Parser* parser) {
+// replace the code for everything since expr started with a single load of value
+static void foldInto(Compiler* compiler, ExprInfo* expr, Value value) {
+    discardExpr(compiler, expr);
+    emitValue(compiler, compiler->parser.previous.line, value);
+    setConstantExpr(compiler, value);
+}
+
+static void number(Compiler* compiler) {
+    Token* token = &compiler->parser.previous;
+#ifdef CLOX_STRTOD
+    // the old way, for bench/literals.sh to compare against
+    double value = strtod(token->start, NULL);
+#else
+    double value = parseNumber(token->start, token->length);
+#endif
+    emitConstant(compiler, token->line, NUMBER_VAL(value));
+    setConstantExpr(compiler, NUMBER_VAL(value));
+}
+
+// consume a string literal, given it's in the compiler->parser.previous token
+static void string(Compiler* compiler) {
     // note that the +1 and -2 are just trimming the quotation marks around the
     // string literal
-    ObjString* str = copyString(parser->previous.start + 1, parser->previous.length - 2);
-    Value value = OBJ_VAL(str);
-    emitConstant(parser->previous.line, value);
+    ObjString* str = copyString(compiler->vm, compiler->parser.previous.start + 1, compiler->parser.previous.length - 2);
+    if (str == NULL) {
+        error(compiler, "Out of memory.");
+    }
+    // nil stands in for it, so the compile can carry on to report anything else
+    Value value = str != NULL ? OBJ_VAL(str) : NIL_VAL;
+    emitConstant(compiler, compiler->parser.previous.line, value);
+    setConstantExpr(compiler, value);
+}
+
+// the opcode computing !(op), for the comparisons; -1 for anything else.
+// == and != are each other's negation, the rest have fused compare-and-negate forms
+static int negatedComparison(int op) {
+    switch (op) {
+        case OP_EQUAL:              return OP_NOT_EQUAL;
+        case OP_NOT_EQUAL:          return OP_EQUAL;
+        case OP_GREATER:            return OP_NOT_GREATER;
+        case OP_NOT_GREATER:        return OP_GREATER;
+        case OP_GREATER_EQUAL:      return OP_NOT_GREATER_EQUAL;
+        case OP_NOT_GREATER_EQUAL:  return OP_GREATER_EQUAL;
+        case OP_LESS:               return OP_NOT_LESS;
+        case OP_NOT_LESS:           return OP_LESS;
+        case OP_LESS_EQUAL:         return OP_NOT_LESS_EQUAL;
+        case OP_NOT_LESS_EQUAL:     return OP_LESS_EQUAL;
+        default:                    return -1;
+    }
 }
 
-static void unary(Scanner* scanner, Parser* parser) {
-    TokenType operatorType = parser->previous.type;
+static void unary(Compiler* compiler) {
+    TokenType operatorType = compiler->parser.previous.type;
+
+    parsePrecedence(compiler, PREC_UNARY);
 
-    parsePrecedence(scanner, parser, PREC_UNARY);
+    ExprInfo operand = compiler->parser.expr;
 
     switch (operatorType) {
         case TOKEN_BANG:
-            emitByte(parser->previous.line, OP_NOT);
+            if (compiler->foldConstants && operand.isConstant) {
+                foldInto(compiler, &operand, BOOL_VAL(isFalsey(operand.value)));
+                return;
+            }
+
+            // a comparison we just emitted can absorb the ! instead
+            if (compiler->fuseInstructions && negatedComparison(operand.rootOp) != -1) {
+                OP_CODE negated = negatedComparison(operand.rootOp);
+                currentChunk(compiler)->code[currentChunk(compiler)->count - 1] = negated;
+                setComputedExpr(compiler, negated, EXPR_BOOL);
+                return;
+            }
+
+            emitByte(compiler, compiler->parser.previous.line, OP_NOT);
+            setComputedExpr(compiler, OP_NOT, EXPR_BOOL);
             break;
 
         case TOKEN_MINUS:
-            emitByte(parser->previous.line, OP_NEGATE);
+            // negating anything but a number is a runtime error, so leave that to the VM
+            if (compiler->foldConstants && operand.isConstant && IS_NUMBER(operand.value)) {
+                foldInto(compiler, &operand, NUMBER_VAL(-AS_NUMBER(operand.value)));
+                return;
+            }
+
+            emitByte(compiler, compiler->parser.previous.line, OP_NEGATE);
+            setComputedExpr(compiler, OP_NEGATE, EXPR_NUMBER);
             break;
         
         default:
@@ -261,47 +432,272 @@ static void unary(Scanner* scanner, Parser* parser) {
     }
 }
 
-static void literal(Scanner* scanner, Parser* parser) {
-    #define EMIT_BYTE(b)    { int lineNumber = parser->previous.line; emitByte(lineNumber, b); break; }
-    switch (parser->previous.type) {
-        case TOKEN_FALSE:   EMIT_BYTE(OP_FALSE)
-        case TOKEN_TRUE:    EMIT_BYTE(OP_TRUE)
-        case TOKEN_NIL:     EMIT_BYTE(OP_NIL)
+static void literal(Compiler* compiler) {
+    #define EMIT_BYTE(b, v)    { int lineNumber = compiler->parser.previous.line; emitByte(compiler, lineNumber, b); setConstantExpr(compiler, v); break; }
+    switch (compiler->parser.previous.type) {
+        case TOKEN_FALSE:   EMIT_BYTE(OP_FALSE, BOOL_VAL(false))
+        case TOKEN_TRUE:    EMIT_BYTE(OP_TRUE,  BOOL_VAL(true))
+        case TOKEN_NIL:     EMIT_BYTE(OP_NIL,   NIL_VAL)
         default:
             // unreachable?
             return;
     }
+    #undef EMIT_BYTE
+}
+
+// evaluates a binary operator on two known values, exactly as the VM would.
+// Returns false (and leaves result alone) if the VM would report a runtime error
+// instead; those stay in the bytecode, so the error still happens at runtime.
+static bool foldBinary(VM* vm, TokenType operatorType, Value a, Value b, Value* result) {
+    bool numbers = IS_NUMBER(a) && IS_NUMBER(b);
+
+    #define FOLD_NUMBERS(valueType, op) \
+        if (!numbers) { \
+            return false; \
+        } \
+        *result = valueType(AS_NUMBER(a) op AS_NUMBER(b)); \
+        return true;
+
+    switch (operatorType) {
+        case TOKEN_PLUS:
+            if (IS_STRING(a) && IS_STRING(b)) {
+                // no room for it now means no room at runtime either; that's where the
+                // error belongs
+                ObjString* string = concatenateStrings(vm, AS_STRING(a), AS_STRING(b));
+                if (string == NULL) {
+                    return false;
+                }
+                *result = OBJ_VAL(string);
+                return true;
+            }
+            FOLD_NUMBERS(NUMBER_VAL, +)
+
+        case TOKEN_MINUS:           FOLD_NUMBERS(NUMBER_VAL, -)
+        case TOKEN_STAR:            FOLD_NUMBERS(NUMBER_VAL, *)
+        case TOKEN_SLASH:           FOLD_NUMBERS(NUMBER_VAL, /)
+        case TOKEN_GREATER:         FOLD_NUMBERS(BOOL_VAL, >)
+        case TOKEN_GREATER_EQUAL:   FOLD_NUMBERS(BOOL_VAL, >=)
+        case TOKEN_LESS:            FOLD_NUMBERS(BOOL_VAL, <)
+        case TOKEN_LESS_EQUAL:      FOLD_NUMBERS(BOOL_VAL, <=)
+
+        case TOKEN_EQUAL_EQUAL:
+            *result = BOOL_VAL(valuesEqual(a, b));
+            return true;
+
+        case TOKEN_BANG_EQUAL:
+            *result = BOOL_VAL(!valuesEqual(a, b));
+            return true;
+
+        default:
+            return false;
+    }
+
+    #undef FOLD_NUMBERS
+}
+
+// x * 1, x / 1 and x - (+0) are exactly x for every double (signed zeros and NaNs included),
+// so if x is known to be a number, the operation can go. If x might not be a number the
+// operation has to stay, since it's what reports the error.
+static bool isRightIdentity(TokenType operatorType, ExprInfo* left, ExprInfo* right) {
+    if (left->type != EXPR_NUMBER || !right->isConstant || !IS_NUMBER(right->value)) {
+        return false;
+    }
+
+    double b = AS_NUMBER(right->value);
+    switch (operatorType) {
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+            return b == 1;
+        case TOKEN_MINUS:
+            // only +0: -0 - -0 is +0, not -0
+            return b == 0 && !signbit(b);
+        default:
+            return false;
+    }
+}
+
+// what expr is known to add up as: a constant, or a chain that can't fail (whose sum is a
+// string or a number, like its operands)
+static ChainKind operandKind(ExprInfo* expr) {
+    if (expr->rootOp == OP_CONCAT) {
+        return expr->chain;
+    }
+    if (!expr->isConstant) {
+        return CHAIN_ANY;
+    }
+    if (IS_STRING(expr->value)) {
+        return CHAIN_STRINGS;
+    }
+    return IS_NUMBER(expr->value) ? CHAIN_NUMBERS : CHAIN_ANY;
+}
+
+// the value loaded by the OP_CONSTANT or OP_CONSTANT_LONG at offset
+static Value loadedConstant(Chunk* chunk, int offset) {
+    uint8_t* operand = &chunk->code[offset + 1];
+    int constant = chunk->code[offset] == OP_CONSTANT
+        ? operand[0]
+        : (operand[0] << 16) | (operand[1] << 8) | operand[2];
+    return chunk->constants.values[constant];
+}
+
+// replaces the code since chain started with a load of its sum, if it's count constant
+// loads and the OP_CONCAT. (The first operand may be a chain of its own instead, if that
+// one wasn't folded.)
+static void foldChain(Compiler* compiler, ExprInfo* chain, int count) {
+    Chunk* chunk = currentChunk(compiler);
+    Value operands[UINT8_MAX];
+
+    int offset = chain->start;
+    for (int i = 0; i < count; i++) {
+        uint8_t opcode = chunk->code[offset];
+        if (opcode != OP_CONSTANT && opcode != OP_CONSTANT_LONG) {
+            return;
+        }
+        operands[i] = loadedConstant(chunk, offset);
+        offset += instructionLength(opcode);
+    }
+
+    // the operands are still in the constant pool, so they're rooted while this allocates.
+    // They're all strings or all numbers, so the only way it can fail is running out of
+    // memory; then the chain stays as it is, to fail at runtime
+    if (addValues(compiler->vm, operands, count) != ADD_OK) {
+        return;
+    }
+    foldInto(compiler, chain, operands[0]);
+}
+
+// A chain of + compiles to one OP_CONCAT n instead of n - 1 OP_ADDs, so adding up n strings
+// is one allocation and one copy rather than a new intermediate string per +.
+//
+// The chain is built as it's parsed: a + that's followed by another + emits OP_CONCAT 2, and
+// each + after it moves its right operand in front of the OP_CONCAT and bumps the count.
+// That evaluates the operand before the add that used to come first, so only constant loads
+// (which can't fail) are moved; and since an OP_CONCAT reports a failure at its own line,
+// every + in it has to be on one line, unless the chain can't fail on its operands' types.
+// Such a chain of strings can still fail with "Out of memory.", and on more than one line
+// that points at the line of the last +, where pairwise adds would name the one that
+// didn't fit. Out of memory is about the whole script more than any one +, so that's
+// traded for the single allocation.
+//
+// With folding on, a chain of constant strings is left alone until it ends, then folded in
+// one go instead of a new constant per +.
+//
+// Returns false if the + isn't part of a chain, and should be compiled as usual.
+static bool concatenation(Compiler* compiler, ExprInfo* left, ExprInfo* right, int lineNumber) {
+    Chunk* chunk = currentChunk(compiler);
+    bool chainGoesOn = compiler->parser.current.type == TOKEN_PLUS;
+    ChainKind rightKind = operandKind(right);
+
+    if (left->rootOp == OP_CONCAT && right->isConstant) {
+        int concatAt = right->start - 2;
+        int count = chunk->code[concatAt + 1];
+        bool cantFail = left->chain != CHAIN_ANY && left->chain == rightKind;
+
+        if (count < UINT8_MAX && (cantFail || getLine(&chunk->lines, concatAt) == lineNumber)) {
+            uint8_t load[4];
+            int loadLength = chunk->count - right->start;
+            memcpy(load, &chunk->code[right->start], loadLength);
+
+            // the constant stays in the pool; only the code after the chain's operands is redone
+            truncateCode(chunk, concatAt);
+            for (int i = 0; i < loadLength; i++) {
+                emitByte(compiler, lineNumber, load[i]);
+            }
+            emitBytes(compiler, lineNumber, OP_CONCAT, count + 1);
+            setComputedExpr(compiler, OP_CONCAT, EXPR_ANY);
+            compiler->parser.expr.chain = cantFail ? rightKind : CHAIN_ANY;
+
+            if (compiler->foldConstants && cantFail && (!chainGoesOn || count + 1 == UINT8_MAX)) {
+                foldChain(compiler, left, count + 1);
+            }
+            return true;
+        }
+    }
+
+    if (!chainGoesOn) {
+        return false;
+    }
+
+    ChainKind kind = operandKind(left) == rightKind ? rightKind : CHAIN_ANY;
+    // two numbers fold as usual; it's strings that would make an intermediate
+    if (compiler->foldConstants && kind == CHAIN_NUMBERS) {
+        return false;
+    }
+
+    emitBytes(compiler, lineNumber, OP_CONCAT, 2);
+    setComputedExpr(compiler, OP_CONCAT, EXPR_ANY);
+    compiler->parser.expr.chain = kind;
+    return true;
 }
 
 // parse+consume a binary infix expression
-// called after the first operand has been consumed and the operator is in parser->previous
-static void binary(Scanner* scanner, Parser* parser) {
-    TokenType operatorType = parser->previous.type;
-    ParseRule* rule = getRule(operatorType);
+// called after the first operand has been consumed and the operator is in compiler->parser.previous
+static void binary(Compiler* compiler) {
+    TokenType operatorType = compiler->parser.previous.type;
+    const ParseRule* rule = getRule(operatorType);
+    ExprInfo left = compiler->parser.expr;
 
     // parse + consume the second operand, based on the precedence of the operand itself
     // note the right hand operation is 1 level higher than the left; this ensure that
     // 1+2+3 is parsed as (1+2)+3
     // aka left associativity
-    parsePrecedence(scanner, parser, (Precedence) (rule->precedence + 1));
+    parsePrecedence(compiler, (Precedence) (rule->precedence + 1));
+
+    ExprInfo right = compiler->parser.expr;
 
     // then emit the operand's OP_CODE itself; we use a macro to condense the switch block
-    int lineNumber = parser->previous.line;
+    int lineNumber = compiler->parser.previous.line;
+
+    // goes before folding, which would make a new string for every + of a chain
+    if (operatorType == TOKEN_PLUS && compiler->fuseInstructions
+            && concatenation(compiler, &left, &right, lineNumber)) {
+        return;
+    }
+
+    if (compiler->foldConstants) {
+        Value folded;
+        if (left.isConstant && right.isConstant && foldBinary(compiler->vm, operatorType, left.value, right.value, &folded)) {
+            foldInto(compiler, &left, folded);
+            return;
+        }
+
+        if (isRightIdentity(operatorType, &left, &right)) {
+            discardExpr(compiler, &right);
+            compiler->parser.expr = left;
+            return;
+        }
+    }
+
+    // a right operand that's just `OP_CONSTANT idx` merges into the operation
+    bool rightIsShortConstant = compiler->fuseInstructions
+        && currentChunk(compiler)->count - right.start == 2
+        && currentChunk(compiler)->code[right.start] == OP_CONSTANT;
+
+    if (rightIsShortConstant && (operatorType == TOKEN_PLUS || operatorType == TOKEN_STAR)) {
+        OP_CODE fused = operatorType == TOKEN_PLUS ? OP_ADD_CONSTANT : OP_MULTIPLY_CONSTANT;
+        uint8_t constant = currentChunk(compiler)->code[right.start + 1];
+
+        // the constant stays in the pool; only the load goes
+        truncateCode(currentChunk(compiler), right.start);
+        emitBytes(compiler, lineNumber, fused, constant);
+        setComputedExpr(compiler, fused, fused == OP_ADD_CONSTANT ? EXPR_ANY : EXPR_NUMBER);
+        return;
+    }
 
-    #define EMIT_OP(TOK, TOK_OP) case TOK: { emitByte(lineNumber, TOK_OP); break; }
+    #define EMIT_OP(TOK, TOK_OP, TYPE) case TOK: { emitByte(compiler, lineNumber, TOK_OP); setComputedExpr(compiler, TOK_OP, TYPE); break; }
 
     switch (operatorType) {
-        EMIT_OP(TOKEN_PLUS,  OP_ADD)
-        EMIT_OP(TOKEN_MINUS, OP_SUBTRACT)
-        EMIT_OP(TOKEN_STAR,  OP_MULTIPLY)
-        EMIT_OP(TOKEN_SLASH, OP_DIVIDE)
-
-        EMIT_OP(TOKEN_BANG_EQUAL,    OP_NOT_EQUAL)
-        EMIT_OP(TOKEN_EQUAL_EQUAL,   OP_EQUAL)
-        EMIT_OP(TOKEN_GREATER,       OP_GREATER)
-        EMIT_OP(TOKEN_GREATER_EQUAL, OP_GREATER_EQUAL)
-        EMIT_OP(TOKEN_LESS,          OP_LESS)
-        EMIT_OP(TOKEN_LESS_EQUAL,    OP_LESS_EQUAL)
+        EMIT_OP(TOKEN_PLUS,  OP_ADD,      EXPR_ANY)
+        EMIT_OP(TOKEN_MINUS, OP_SUBTRACT, EXPR_NUMBER)
+        EMIT_OP(TOKEN_STAR,  OP_MULTIPLY, EXPR_NUMBER)
+        EMIT_OP(TOKEN_SLASH, OP_DIVIDE,   EXPR_NUMBER)
+
+        EMIT_OP(TOKEN_BANG_EQUAL,    OP_NOT_EQUAL,     EXPR_BOOL)
+        EMIT_OP(TOKEN_EQUAL_EQUAL,   OP_EQUAL,         EXPR_BOOL)
+        EMIT_OP(TOKEN_GREATER,       OP_GREATER,       EXPR_BOOL)
+        EMIT_OP(TOKEN_GREATER_EQUAL, OP_GREATER_EQUAL, EXPR_BOOL)
+        EMIT_OP(TOKEN_LESS,          OP_LESS,          EXPR_BOOL)
+        EMIT_OP(TOKEN_LESS_EQUAL,    OP_LESS_EQUAL,    EXPR_BOOL)
 
         default: {
             // unreachable?
@@ -312,24 +708,24 @@ static void binary(Scanner* scanner, Parser* parser) {
     #undef EMIT_OP
 }
 
-bool compile(const char* source, Chunk* chunk) {
-    Scanner scanner;
-    initScanner(&scanner, source);
-
-    // TODO: i truly do not understand the state management in this book around all these globals
-    compilingChunk = chunk;
+bool compile(VM* vm, const char* source, Chunk* chunk) {
+    Compiler context;
+    Compiler* compiler = &context;
 
-    Parser parser;
+    initScanner(&compiler->scanner, source);
+    compiler->parser.panicMode = false;
+    compiler->parser.hadError = false;
+    compiler->chunk = chunk;
+    compiler->vm = vm;
+    compiler->foldConstants = vm->foldConstants;
+    compiler->fuseInstructions = vm->fuseInstructions;
 
-    parser.panicMode = false;
-    parser.hadError = false;
-    
-    advance(&scanner, &parser);
-    expression(&scanner, &parser);
+    advance(compiler);
+    expression(compiler);
 
-    consume(&scanner, &parser, TOKEN_EOF, "Expect end of expression.");
+    consume(compiler, TOKEN_EOF, "Expect end of expression.");
 
-    endCompiler(&parser);
+    endCompiler(compiler);
 
-    return !parser.hadError;
-}
\ No newline at end of file
+    return !compiler->parser.hadError;
+}
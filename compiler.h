@@ -4,6 +4,7 @@
 #ifndef clox_compiler_h
 #define clox_compiler_h
 
-bool compile(const char* source, Chunk* chunk);
+// compiles source into chunk; any strings it makes are interned into vm
+bool compile(VM* vm, const char* source, Chunk* chunk);
 
 #endif
\ No newline at end of file
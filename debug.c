@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "debug.h"
 #include "value.h"
@@ -9,11 +10,31 @@ static int simpleInstruction(const char* name, int offset) {
     return offset + 1;
 }
 
+static int disassembleInstructionAt(Chunk* chunk, int offset, int line, int previousLine);
+
 void disassambleChunk(Chunk* chunk, const char* name) {
     printf("== %s ==\n", name);
+
+    // walk the line table alongside the code, instead of searching it for every instruction
+    LineCursor cursor;
+    initLineCursor(&cursor, &chunk->lines);
+    int previousLine = -1;
+
     for (int offset = 0; offset < chunk->count;) {
-        offset = disassembleInstruction(chunk, offset);
+        int line = advanceLineCursor(&cursor, offset);
+        offset = disassembleInstructionAt(chunk, offset, line, previousLine);
+        previousLine = line;
     }
+
+    printf("== %d bytes of code, %d line records (%zu bytes) ==\n",
+        chunk->count, chunk->lines.count, chunk->lines.count * sizeof(LineRecord));
+    printf("== %d constants, %d more saved by dedup ==\n",
+        chunk->constants.count, chunk->constantsDeduped);
+}
+
+static int byteInstruction(const char* name, Chunk* chunk, int offset) {
+    printf("%-16s %4d\n", name, chunk->code[offset+1]);
+    return offset+2;
 }
 
 static int constantInstruction(const char* name, Chunk* chunk, int offset) {
@@ -36,29 +57,24 @@ static int constantInstructionLong(const char* name, Chunk* chunk, int offset) {
     return offset+4;
 }
 
-static void printLineNumber(Chunk* chunk, int offset) {
-    // TODO: using getLine is fine for random access but this is really bad
-    // for iteration performance. Better to use a running counter or something.
-    if (offset == 0) {
-        int lineIdx = getLine(&chunk->lines, offset);
-        printf("%04d ",lineIdx);
-        return;
-    }
-
-    int thisLine = getLine(&chunk->lines, offset);
-    int lastLine = getLine(&chunk->lines, offset-1);
-
-    if (thisLine == lastLine) {
+static void printLineNumber(int line, int previousLine) {
+    if (line == previousLine) {
         printf("   | ");
     } else {
-        printf("%04d ", thisLine);
+        printf("%04d ", line);
     }
 }
 
 int disassembleInstruction(Chunk* chunk, int offset) {
+    int line = getLine(&chunk->lines, offset);
+    int previousLine = offset == 0 ? -1 : getLine(&chunk->lines, offset - 1);
+    return disassembleInstructionAt(chunk, offset, line, previousLine);
+}
+
+static int disassembleInstructionAt(Chunk* chunk, int offset, int line, int previousLine) {
     printf("%04d ", offset);
 
-    printLineNumber(chunk, offset);
+    printLineNumber(line, previousLine);
 
     #define SIMPLE(op)      case op: return simpleInstruction(#op, offset);
 
@@ -86,11 +102,116 @@ int disassembleInstruction(Chunk* chunk, int offset) {
         SIMPLE(OP_LESS_EQUAL)  
         SIMPLE(OP_GREATER)  
         SIMPLE(OP_GREATER_EQUAL)  
-        
+
+        case OP_ADD_CONSTANT:
+            return constantInstruction("OP_ADD_CONSTANT", chunk, offset);
+
+        case OP_MULTIPLY_CONSTANT:
+            return constantInstruction("OP_MULTIPLY_CONSTANT", chunk, offset);
+
+        SIMPLE(OP_NOT_GREATER)
+        SIMPLE(OP_NOT_GREATER_EQUAL)
+        SIMPLE(OP_NOT_LESS)
+        SIMPLE(OP_NOT_LESS_EQUAL)
+
+        case OP_CONCAT:
+            return byteInstruction("OP_CONCAT", chunk, offset);
+
         default:
             printf("Unknown opcode %d\n", instruction);
             return offset + 1;
     }
 
     #undef SIMPLE
-}
\ No newline at end of file
+}
+
+const char* opcodeName(uint8_t opcode) {
+    #define NAME(op)    case op: return #op;
+
+    switch (opcode) {
+        NAME(OP_CONSTANT)
+        NAME(OP_CONSTANT_LONG)
+        NAME(OP_NIL)
+        NAME(OP_TRUE)
+        NAME(OP_FALSE)
+        NAME(OP_EQUAL)
+        NAME(OP_NOT_EQUAL)
+        NAME(OP_GREATER)
+        NAME(OP_GREATER_EQUAL)
+        NAME(OP_LESS)
+        NAME(OP_LESS_EQUAL)
+        NAME(OP_ADD)
+        NAME(OP_SUBTRACT)
+        NAME(OP_MULTIPLY)
+        NAME(OP_DIVIDE)
+        NAME(OP_NOT)
+        NAME(OP_NEGATE)
+        NAME(OP_RETURN)
+        NAME(OP_ADD_CONSTANT)
+        NAME(OP_MULTIPLY_CONSTANT)
+        NAME(OP_NOT_GREATER)
+        NAME(OP_NOT_GREATER_EQUAL)
+        NAME(OP_NOT_LESS)
+        NAME(OP_NOT_LESS_EQUAL)
+        NAME(OP_CONCAT)
+        default: return "OP_UNKNOWN";
+    }
+
+    #undef NAME
+}
+
+typedef struct {
+    uint8_t first;
+    uint8_t second;
+    long count;
+} OpcodePair;
+
+static int compareOpcodePairs(const void* a, const void* b) {
+    long countA = ((const OpcodePair*) a)->count;
+    long countB = ((const OpcodePair*) b)->count;
+    return (countA < countB) - (countA > countB);
+}
+
+void printOpcodePairs(Chunk* chunk) {
+    long counts[OP_CODE_COUNT][OP_CODE_COUNT] = { { 0 } };
+    long total = 0;
+
+    int previous = -1;
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t opcode = chunk->code[offset];
+        int length = instructionLength(opcode);
+        if (length < 0) {
+            printf("Unknown opcode %d at %04d; stopping the pair count there\n", opcode, offset);
+            break;
+        }
+
+        if (previous != -1) {
+            counts[previous][opcode]++;
+            total++;
+        }
+        previous = opcode;
+        offset += length;
+    }
+
+    OpcodePair pairs[OP_CODE_COUNT * OP_CODE_COUNT];
+    int pairCount = 0;
+    for (int first = 0; first < OP_CODE_COUNT; first++) {
+        for (int second = 0; second < OP_CODE_COUNT; second++) {
+            if (counts[first][second] > 0) {
+                pairs[pairCount].first = first;
+                pairs[pairCount].second = second;
+                pairs[pairCount].count = counts[first][second];
+                pairCount++;
+            }
+        }
+    }
+
+    qsort(pairs, pairCount, sizeof(OpcodePair), compareOpcodePairs);
+
+    printf("== opcode pairs (%ld total) ==\n", total);
+    for (int i = 0; i < pairCount; i++) {
+        printf("%10ld %6.2f%%  %-22s %s\n",
+            pairs[i].count, 100.0 * pairs[i].count / total,
+            opcodeName(pairs[i].first), opcodeName(pairs[i].second));
+    }
+}
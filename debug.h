@@ -6,4 +6,11 @@
 void disassambleChunk(Chunk* chunk, const char* name);
 int disassembleInstruction(Chunk* chunk, int offset);
 
+// the name of an opcode, like "OP_ADD"; "OP_UNKNOWN" for anything that isn't one
+const char* opcodeName(uint8_t opcode);
+
+// prints how many times each pair of adjacent instructions occurs in the chunk, most common
+// first. This is what a superinstruction has to earn its dispatch slot against.
+void printOpcodePairs(Chunk* chunk);
+
 #endif
\ No newline at end of file
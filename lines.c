@@ -11,10 +11,15 @@ void initLinesArray(LineRecordArray* array) {
 }
 
 void writeLinesArray(LineRecordArray* array, int lineIdx, int codeIdx) {
+    // still on the same line, so the current run just gets longer
+    if (array->count > 0 && array->records[array->count - 1].lineIdx == lineIdx) {
+        return;
+    }
+
     if (array -> capacity < array->count + 1) {
         int oldCapacity = array->capacity;
         array->capacity = GROW_CAPACITY(oldCapacity);
-        array->records = GROW_ARRAY(LineRecord, array->records, oldCapacity, array->capacity);
+        array->records = GROW_ARRAY(MEM_LINES, LineRecord, array->records, oldCapacity, array->capacity);
     }
     LineRecord lr;
     lr.lineIdx = lineIdx;
@@ -24,17 +29,51 @@ void writeLinesArray(LineRecordArray* array, int lineIdx, int codeIdx) {
 }
 
 void freeLinesArray(LineRecordArray* array) {
-    FREE_ARRAY(LineRecord, array->records, array->capacity);
+    FREE_ARRAY(MEM_LINES, LineRecord, array->records, array->capacity);
     initLinesArray(array);
 }
 
-// TODO perf -- this should at least be a binary search, this is an embarassment
+void truncateLinesArray(LineRecordArray* array, int codeIdx) {
+    while (array->count > 0 && array->records[array->count - 1].codeIdx >= codeIdx) {
+        array->count -= 1;
+    }
+}
+
 int getLine(LineRecordArray* array, int codeIdx) {
-    for (int i = 0; i < array->count; i++) {
-        LineRecord record = array->records[i];
-        if (record.codeIdx == codeIdx) {
-            return record.lineIdx;
+    if (array->count == 0 || codeIdx < array->records[0].codeIdx) {
+        return -1;
+    }
+
+    // find the last run starting at or before codeIdx
+    int low = 0;
+    int high = array->count - 1;
+    while (low < high) {
+        // round up, so low always moves when it's assigned
+        int mid = low + (high - low + 1) / 2;
+        if (array->records[mid].codeIdx <= codeIdx) {
+            low = mid;
+        } else {
+            high = mid - 1;
         }
     }
-    return -1;
+
+    return array->records[low].lineIdx;
+}
+
+void initLineCursor(LineCursor* cursor, LineRecordArray* array) {
+    cursor->array = array;
+    cursor->record = 0;
+}
+
+int advanceLineCursor(LineCursor* cursor, int codeIdx) {
+    LineRecordArray* array = cursor->array;
+    if (array->count == 0 || codeIdx < array->records[0].codeIdx) {
+        return -1;
+    }
+
+    while (cursor->record + 1 < array->count && array->records[cursor->record + 1].codeIdx <= codeIdx) {
+        cursor->record += 1;
+    }
+
+    return array->records[cursor->record].lineIdx;
 }
@@ -3,25 +3,45 @@
 
 #include "common.h"
 
+// The line table is run-length encoded: a record marks the code index where a
+// run of bytecode from one source line starts, and the run goes on until the
+// next record. Bytecode comes out in source order, so this is one record per
+// line change rather than one per byte of code.
 typedef struct {
     // line number
     int lineIdx;
-    // code index in the chunk
+    // code index in the chunk where this line's run starts
     int codeIdx;
 } LineRecord;
 
 typedef struct {
     int capacity;
     int count;
+    // sorted by codeIdx, strictly increasing
     LineRecord* records;
 } LineRecordArray;
 
+// for walking a chunk's lines front to back without searching each time
+typedef struct {
+    LineRecordArray* array;
+    // the record covering the last code index we were asked about
+    int record;
+} LineCursor;
+
 void initLinesArray(LineRecordArray* array);
+// codeIdx must be one past the last one written; only starts a new run if the line changed
 void writeLinesArray(LineRecordArray* array, int lineIdx, int codeIdx);
 void freeLinesArray(LineRecordArray* array);
+// forget the lines of every code index from codeIdx on
+void truncateLinesArray(LineRecordArray* array, int codeIdx);
 
 // returns the lineIdx associated to a given codeIdx
 // returns -1 if there is none such.
 int getLine(LineRecordArray* array, int codeIdx);
 
-#endif
\ No newline at end of file
+void initLineCursor(LineCursor* cursor, LineRecordArray* array);
+// same as getLine, but codeIdx must never go down between calls on the same cursor;
+// amortized constant time for a front-to-back walk
+int advanceLineCursor(LineCursor* cursor, int codeIdx);
+
+#endif
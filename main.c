@@ -1,6 +1,16 @@
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
 #include "common.h"
 #include "chunk.h"
+#include "compiler.h"
 #include "debug.h"
+#include "memory.h"
+#include "pool.h"
+#include "serialize.h"
 #include "vm.h"
 
 static void repl(VM* vm) {
@@ -18,46 +28,577 @@ static void repl(VM* vm) {
         }
 
         interpret(vm, line);
+        flushOutput(vm);
+    }
+}
+
+// the chunk cache's counters, as more fields for one of the JSON objects below
+static void printCacheStats(CacheStats* stats) {
+    fprintf(stderr, ", \"cache_hits\": %llu, \"cache_disk_hits\": %llu, \"cache_misses\": %llu"
+        ", \"cache_evictions\": %llu, \"cache_disk_writes\": %llu",
+        (unsigned long long) stats->hits,
+        (unsigned long long) stats->diskHits,
+        (unsigned long long) stats->misses,
+        (unsigned long long) stats->evictions,
+        (unsigned long long) stats->diskWrites);
+}
+
+// one JSON object on stderr, so bench/suite.sh (or anything else) can pick it up
+static void printStats(VM* vm) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(stderr, "{\"instructions\": %llu, \"compile_ns\": %llu, \"run_ns\": %llu, \"max_rss_kb\": %ld",
+        (unsigned long long) vm->stats.instructions,
+        (unsigned long long) vm->stats.compileNanos,
+        (unsigned long long) vm->stats.runNanos,
+        usage.ru_maxrss);
+    if (cacheEnabled(&vm->cache)) {
+        printCacheStats(&vm->cache.stats);
+    }
+    fprintf(stderr, "}\n");
+}
+
+static bool hasSuffix(const char* string, const char* suffix) {
+    size_t length = strlen(string);
+    size_t suffixLength = strlen(suffix);
+    return length >= suffixLength && strcmp(string + length - suffixLength, suffix) == 0;
+}
+
+// Runs the script at path and returns the exit code for how that went: 0, 65 for a compile
+// error (or bytecode that wouldn't load), 70 for a runtime error, 74 if it couldn't be read.
+// A .loxc file is loaded and run as is; anything else is treated as source.
+static int runScript(VM* vm, const char* path) {
+    InterpretResult result;
+
+    if (hasSuffix(path, ".loxc")) {
+        Chunk chunk;
+        initChunk(&chunk);
+        if (!loadChunk(vm, path, &chunk, vm->err)) {
+            return 65;
+        }
+        result = interpretChunk(vm, &chunk);
+        freeChunk(&chunk);
+    } else {
+        // mapped if possible; read otherwise
+        MappedFile source;
+        if (!mapFile(path, &source, vm->err)) {
+            return 74;
+        }
+        result = interpret(vm, source.data);
+        unmapFile(&source);
+    }
+    flushOutput(vm);
+
+    switch (result) {
+        case INTERPRET_OK: return 0;
+        case INTERPRET_COMPILE_ERROR: return 65;
+        case INTERPRET_RUNTIME_ERROR: return 70;
+    }
+    return 70;
+}
+
+static void runFile(VM* vm, const char* path) {
+    int status = runScript(vm, path);
+
+    // only for scripts that actually got as far as running
+    if (vm->collectStats && status != 74) {
+        printStats(vm);
+    }
+
+    exit(status);
+}
+
+// a VM for a worker thread, with the compiler and engine settings of options
+static void initWorkerVM(VM* vm, VM* options) {
+    initVM(vm);
+    vm->foldConstants = options->foldConstants;
+    vm->fuseInstructions = options->fuseInstructions;
+    vm->engine = options->engine;
+    vm->gcGrowFactor = options->gcGrowFactor;
+    vm->heapLimit = options->heapLimit;
+    vm->cache.capacity = options->cache.capacity;
+    vm->cache.directory = options->cache.directory;
+}
+
+// compiles the source at inPath and writes the bytecode to outPath, for runFile to pick up later.
+// Returns the exit code for how that went: 0, 65 for a compile error, 74 if a file couldn't be
+// read or written
+static int compileFile(VM* vm, const char* inPath, const char* outPath) {
+    MappedFile source;
+    if (!mapFile(inPath, &source, vm->err)) {
+        return 74;
     }
+
+    Chunk chunk;
+    initChunk(&chunk);
+    // so the constants stay rooted while compiling
+    vm->chunk = &chunk;
+
+    bool compiled = compile(vm, source.data, &chunk);
+    unmapFile(&source);
+
+    int status = 0;
+    if (!compiled) {
+        status = 65;
+    } else if (!saveChunk(&chunk, outPath)) {
+        status = 74;
+    }
+
+    vm->chunk = NULL;
+    freeChunk(&chunk);
+    return status;
 }
 
-static char* readFile(const char* path) {
-    FILE* file = fopen(path, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "Could not open file \"%s\".\n", path);
+// where --compile puts the bytecode for path when there's no -o: foo.lox becomes foo.loxc,
+// anything else gets .loxc added
+static char* loxcPathFor(const char* path) {
+    size_t length = strlen(path);
+    if (hasSuffix(path, ".lox")) {
+        length -= strlen(".lox");
+    }
+
+    char* output = ALLOCATE(MEM_OTHER, char, length + strlen(".loxc") + 1);
+    memcpy(output, path, length);
+    strcpy(output + length, ".loxc");
+    return output;
+}
+
+// state shared by the threads of compileFiles; each worker compiles with its own VM
+typedef struct {
+    const char** paths;
+    char** outputs;
+    int* statuses;
+    VM* vms;
+} CompileBatch;
+
+static void compileTask(void* context, int index, int worker) {
+    CompileBatch* batch = (CompileBatch*) context;
+    VM* vm = &batch->vms[worker];
+
+    // a file's messages are collected and written out in one go, so files compiling at
+    // the same time can't interleave theirs
+    char* messages = NULL;
+    size_t messagesLength = 0;
+    FILE* err = open_memstream(&messages, &messagesLength);
+    if (err == NULL) {
+        fprintf(stderr, "Could not buffer the errors of \"%s\".\n", batch->paths[index]);
         exit(74);
     }
+    vm->err = err;
+
+    batch->statuses[index] = compileFile(vm, batch->paths[index], batch->outputs[index]);
+
+    // the compiler's own messages don't say which file they're about
+    if (batch->statuses[index] == 65) {
+        fprintf(err, "Could not compile \"%s\".\n", batch->paths[index]);
+    }
+
+    fclose(err);
+    vm->err = stderr;
+    fwrite(messages, 1, messagesLength, stderr);
+    free(messages);
+}
+
+// compiles every path to its .loxc on `jobs` threads, with the compiler settings from options.
+// Returns the worst exit code of them all
+static int compileFiles(VM* options, const char** paths, int count, int jobs) {
+    if (jobs > count) {
+        jobs = count;
+    }
+
+    CompileBatch batch;
+    batch.paths = paths;
+    batch.outputs = ALLOCATE(MEM_OTHER, char*, count);
+    batch.statuses = ALLOCATE(MEM_OTHER, int, count);
+    batch.vms = ALLOCATE(MEM_OTHER, VM, jobs);
+
+    for (int i = 0; i < count; i++) {
+        batch.outputs[i] = loxcPathFor(paths[i]);
+    }
+    for (int i = 0; i < jobs; i++) {
+        initWorkerVM(&batch.vms[i], options);
+        batch.vms[i].dumpCode = options->dumpCode;
+    }
+
+    runParallel(jobs, count, compileTask, &batch);
+
+    // a compile error says more than a file that couldn't be written
+    int status = 0;
+    for (int i = 0; i < count; i++) {
+        if (batch.statuses[i] == 65) {
+            status = 65;
+        } else if (status == 0) {
+            status = batch.statuses[i];
+        }
+        FREE_ARRAY(MEM_OTHER, char, batch.outputs[i], strlen(batch.outputs[i]) + 1);
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        freeVM(&batch.vms[i]);
+    }
+    FREE_ARRAY(MEM_OTHER, VM, batch.vms, jobs);
+    FREE_ARRAY(MEM_OTHER, int, batch.statuses, count);
+    FREE_ARRAY(MEM_OTHER, char*, batch.outputs, count);
+    return status;
+}
+
+// what --batch collects for each script, until it's that script's turn to be printed
+typedef struct {
+    // runScript's exit code
+    int status;
+    // everything the script wrote, result and errors alike, in the order it wrote them
+    char* output;
+    size_t outputLength;
+    RunStats stats;
+    bool done;
+} ScriptResult;
 
-    fseek(file, 0L, SEEK_END);
-    size_t fileSize = ftell(file);
-    rewind(file);
+// state shared by the threads of runBatch
+typedef struct {
+    char** paths;
+    int count;
+    ScriptResult* results;
+    VM* vms;
+    bool printStats;
 
-    char* buffer = (char*) malloc(fileSize+1);
-    if (buffer == NULL) {
-        fprintf(stderr, "Not enough memory to read \"%s\" (%lu bytes).\n", path, fileSize+1);
+    // results are printed in path order, as soon as every earlier one has been
+    pthread_mutex_t printLock;
+    int nextToPrint;
+} ScriptBatch;
+
+static const char* statusName(int status) {
+    switch (status) {
+        case 65: return "compile error";
+        case 70: return "runtime error";
+        case 74: return "unreadable";
+        default: return "ok";
+    }
+}
+
+// path as a JSON string; only quotes, backslashes and control characters need escaping
+static void printJsonString(FILE* out, const char* string) {
+    fputc('"', out);
+    for (const char* c = string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// with printLock held
+static void printScriptResult(ScriptBatch* batch, int index) {
+    ScriptResult* result = &batch->results[index];
+    const char* path = batch->paths[index];
+
+    if (result->status == 0) {
+        printf("== %s ==\n", path);
+    } else {
+        printf("== %s (%s) ==\n", path, statusName(result->status));
+    }
+    fwrite(result->output, 1, result->outputLength, stdout);
+
+    if (batch->printStats) {
+        fprintf(stderr, "{\"path\": ");
+        printJsonString(stderr, path);
+        fprintf(stderr, ", \"status\": %d, \"instructions\": %llu, \"compile_ns\": %llu, \"run_ns\": %llu}\n",
+            result->status,
+            (unsigned long long) result->stats.instructions,
+            (unsigned long long) result->stats.compileNanos,
+            (unsigned long long) result->stats.runNanos);
+    }
+
+    free(result->output);
+    result->output = NULL;
+}
+
+static void runScriptTask(void* context, int index, int worker) {
+    ScriptBatch* batch = (ScriptBatch*) context;
+    ScriptResult* result = &batch->results[index];
+    VM* vm = &batch->vms[worker];
+
+    // the worker's VM writes into a buffer of this script's own for the length of the run
+    FILE* output = open_memstream(&result->output, &result->outputLength);
+    if (output == NULL) {
+        fprintf(stderr, "Could not buffer the output of \"%s\".\n", batch->paths[index]);
         exit(74);
     }
+    redirectOutput(vm, output);
+    vm->err = output;
+    memset(&vm->stats, 0, sizeof(vm->stats));
 
-    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-    if (bytesRead != fileSize) {
-        fprintf(stderr, "Could not read all of file \"%s\" (%lu bytes of expected %lu).\n", path, bytesRead, fileSize);
+    result->status = runScript(vm, batch->paths[index]);
+    result->stats = vm->stats;
+    fclose(output);
+
+    pthread_mutex_lock(&batch->printLock);
+    result->done = true;
+    while (batch->nextToPrint < batch->count && batch->results[batch->nextToPrint].done) {
+        printScriptResult(batch, batch->nextToPrint);
+        batch->nextToPrint++;
     }
-    buffer[bytesRead] = '\0';
+    pthread_mutex_unlock(&batch->printLock);
+}
 
-    fclose(file);
-    return buffer;
+static int comparePaths(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
 }
 
-static void runFile(VM* vm, const char* path) {
-    char* source = readFile(path);
-    InterpretResult result = interpret(vm, source);
-    free(source);
+// appends a copy of the first length chars of path to the list
+static void addPath(char*** paths, int* count, int* capacity, const char* path, size_t length) {
+    if (*capacity < *count + 1) {
+        int oldCapacity = *capacity;
+        *capacity = GROW_CAPACITY(oldCapacity);
+        *paths = GROW_ARRAY(MEM_OTHER, char*, *paths, oldCapacity, *capacity);
+    }
 
-    switch (result) {
-        case INTERPRET_OK: exit(0);
-        case INTERPRET_COMPILE_ERROR: exit(65);
-        case INTERPRET_RUNTIME_ERROR: exit(70);
+    char* copy = ALLOCATE(MEM_OTHER, char, length + 1);
+    memcpy(copy, path, length);
+    copy[length] = '\0';
+    (*paths)[(*count)++] = copy;
+}
+
+// The scripts --batch runs: every .lox and .loxc file in source if it's a directory, in name
+// order, or every non-blank line of it otherwise. Returns false if source couldn't be read
+static bool listScripts(const char* source, char*** paths, int* count, int* capacity) {
+    struct stat info;
+    if (stat(source, &info) == 0 && S_ISDIR(info.st_mode)) {
+        DIR* dir = opendir(source);
+        if (dir == NULL) {
+            fprintf(stderr, "Could not open directory \"%s\".\n", source);
+            return false;
+        }
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (!hasSuffix(entry->d_name, ".lox") && !hasSuffix(entry->d_name, ".loxc")) {
+                continue;
+            }
+            size_t length = strlen(source) + 1 + strlen(entry->d_name);
+            char* path = ALLOCATE(MEM_OTHER, char, length + 1);
+            snprintf(path, length + 1, "%s/%s", source, entry->d_name);
+            addPath(paths, count, capacity, path, length);
+            FREE_ARRAY(MEM_OTHER, char, path, length + 1);
+        }
+        closedir(dir);
+
+        // readdir's order depends on the filesystem. An empty directory leaves paths NULL,
+        // which qsort mustn't be given even with nothing to sort
+        if (*count > 0) {
+            qsort(*paths, *count, sizeof(char*), comparePaths);
+        }
+        return true;
+    }
+
+    MappedFile list;
+    if (!mapFile(source, &list, stderr)) {
+        return false;
+    }
+
+    const char* line = list.data;
+    const char* end = list.data + list.size;
+    while (line < end) {
+        const char* lineEnd = memchr(line, '\n', end - line);
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+
+        size_t length = lineEnd - line;
+        while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) {
+            length--;
+        }
+        if (length > 0) {
+            addPath(paths, count, capacity, line, length);
+        }
+        line = lineEnd + 1;
+    }
+
+    unmapFile(&list);
+    return true;
+}
+
+// Runs every script from source (see listScripts) on `jobs` threads, each with its own VM with
+// the settings from options, and prints their results in order however they were scheduled.
+// Returns the exit code of the first script that failed, or 0
+static int runBatch(VM* options, const char* source, int jobs) {
+    char** paths = NULL;
+    int count = 0;
+    int capacity = 0;
+    if (!listScripts(source, &paths, &count, &capacity)) {
+        return 74;
+    }
+    if (jobs > count) {
+        jobs = count;
+    }
+
+    uint64_t start = nowNanos();
+
+    ScriptBatch batch;
+    batch.paths = paths;
+    batch.count = count;
+    batch.results = ALLOCATE(MEM_OTHER, ScriptResult, count);
+    batch.vms = ALLOCATE(MEM_OTHER, VM, jobs);
+    batch.printStats = options->collectStats;
+    pthread_mutex_init(&batch.printLock, NULL);
+    batch.nextToPrint = 0;
+
+    for (int i = 0; i < count; i++) {
+        batch.results[i].output = NULL;
+        batch.results[i].outputLength = 0;
+        batch.results[i].done = false;
+    }
+    for (int i = 0; i < jobs; i++) {
+        initWorkerVM(&batch.vms[i], options);
+        // timings are collected either way; --stats just prints them
+        batch.vms[i].collectStats = true;
+    }
+
+    runParallel(jobs, count, runScriptTask, &batch);
+    fflush(stdout);
+
+    int status = 0;
+    int failed = 0;
+    // every worker has a cache of its own
+    CacheStats cacheStats;
+    memset(&cacheStats, 0, sizeof(cacheStats));
+    for (int i = 0; i < jobs; i++) {
+        CacheStats* worker = &batch.vms[i].cache.stats;
+        cacheStats.hits += worker->hits;
+        cacheStats.diskHits += worker->diskHits;
+        cacheStats.misses += worker->misses;
+        cacheStats.evictions += worker->evictions;
+        cacheStats.diskWrites += worker->diskWrites;
+    }
+    for (int i = 0; i < count; i++) {
+        if (batch.results[i].status != 0) {
+            failed++;
+            if (status == 0) {
+                status = batch.results[i].status;
+            }
+        }
+        FREE_ARRAY(MEM_OTHER, char, paths[i], strlen(paths[i]) + 1);
+    }
+
+    if (options->collectStats) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        fprintf(stderr, "{\"scripts\": %d, \"failed\": %d, \"jobs\": %d, \"wall_ns\": %llu, \"max_rss_kb\": %ld",
+            count, failed, jobs, (unsigned long long) (nowNanos() - start), usage.ru_maxrss);
+        if (cacheEnabled(&options->cache)) {
+            printCacheStats(&cacheStats);
+        }
+        fprintf(stderr, "}\n");
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        freeVM(&batch.vms[i]);
+    }
+    pthread_mutex_destroy(&batch.printLock);
+    FREE_ARRAY(MEM_OTHER, VM, batch.vms, jobs);
+    FREE_ARRAY(MEM_OTHER, ScriptResult, batch.results, count);
+    FREE_ARRAY(MEM_OTHER, char*, paths, capacity);
+    return status;
+}
+
+// a byte count like 4096, 64k or 16m; -1 if it isn't one
+static long long parseSize(const char* text) {
+    char* end;
+    long long size = strtoll(text, &end, 10);
+    if (end == text || size < 0) {
+        return -1;
+    }
+
+    switch (*end) {
+        case '\0': return size;
+        case 'k': case 'K': size *= 1024; break;
+        case 'm': case 'M': size *= 1024 * 1024; break;
+        case 'g': case 'G': size *= 1024 * 1024 * 1024; break;
+        default: return -1;
+    }
+    return end[1] == '\0' ? size : -1;
+}
+
+typedef enum {
+    PROFILE_OFF,
+    PROFILE_TABLE,
+    PROFILE_JSON,
+} ProfileFormat;
+
+// runFile leaves through exit(), so the profile is printed from an atexit handler
+static Profile* exitProfile;
+static ProfileFormat exitProfileFormat;
+
+static void printProfileAtExit(void) {
+    if (exitProfileFormat == PROFILE_JSON) {
+        printProfileJson(exitProfile, stderr);
+    } else {
+        printProfile(exitProfile, stderr);
     }
+    freeProfile(exitProfile);
+}
+
+static void printMemoryCounters(const char* name, MemoryCounters* counters) {
+    fprintf(stderr, "%-14s %14zu %14zu %12llu %12llu\n", name, counters->bytes, counters->peakBytes,
+        (unsigned long long) counters->allocations, (unsigned long long) counters->frees);
+}
+
+// what --mem-stats prints: the allocation counters per category, as of exit (so after the
+// VM was freed, unless runFile exited first)
+static void printMemoryStatsAtExit(void) {
+    MemoryStats stats;
+    readMemoryStats(&stats);
+
+    fprintf(stderr, "%-14s %14s %14s %12s %12s\n", "memory", "bytes at exit", "peak bytes", "allocations", "frees");
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++) {
+        printMemoryCounters(memoryCategoryName(i), &stats.categories[i]);
+    }
+    printMemoryCounters("total", &stats.total);
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: clox [options] [path]\n");
+    fprintf(stderr, "       clox [options] --compile <path> -o <out.loxc>\n");
+    fprintf(stderr, "       clox [options] --compile [--jobs <n>] <path>...\n");
+    fprintf(stderr, "       clox [options] --batch <dir|listfile> [--jobs <n>]\n");
+    fprintf(stderr, "A path ending in .loxc is loaded as compiled bytecode instead of compiled from source.\n");
+    fprintf(stderr, "Without -o, --compile writes foo.lox to foo.loxc, compiling up to n files at a time\n");
+    fprintf(stderr, "(default: one per core).\n");
+    fprintf(stderr, "--batch runs every .lox/.loxc file in dir, or every path listed in listfile, up to n at\n");
+    fprintf(stderr, "a time, and prints each one's output under a \"== path ==\" header, in order. It exits\n");
+    fprintf(stderr, "with the status of the first script that failed; with --stats, each script's timings\n");
+    fprintf(stderr, "and a summary go to stderr as JSON lines.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --gc-grow-factor <f>   grow the GC threshold to f times the surviving heap (default %g)\n",
+        GC_HEAP_GROW_FACTOR);
+    fprintf(stderr, "  --heap-limit <bytes>   fail with \"Out of memory.\" rather than let the objects take more than\n");
+    fprintf(stderr, "                         this (k/m/g suffixes work); with --batch, each script gets it\n");
+    fprintf(stderr, "  --no-fold              compile every operation as written, without constant folding\n");
+    fprintf(stderr, "  --no-fuse              don't emit superinstructions (OP_ADD_CONSTANT etc.)\n");
+    fprintf(stderr, "  --opcode-pairs         print how often each pair of adjacent opcodes occurs in the code\n");
+    fprintf(stderr, "  --engine <name>        run on the \"stack\" VM (the default) or the \"register\" VM\n");
+    fprintf(stderr, "  --dump-code            disassemble the code once it's compiled (and the register code,\n");
+    fprintf(stderr, "                         with --engine register)\n");
+    fprintf(stderr, "  --trace                print every instruction as it runs\n");
+    fprintf(stderr, "  --trace-stack          --trace, plus the whole stack before every instruction\n");
+    fprintf(stderr, "  --stats                after running a file, print instructions executed, compile and run\n");
+    fprintf(stderr, "                         time and peak RSS to stderr as JSON\n");
+    fprintf(stderr, "  --profile              count every opcode and opcode pair executed, and the %s spent in\n",
+        PROFILE_TICK_UNIT);
+    fprintf(stderr, "                         each; prints a table to stderr at exit\n");
+    fprintf(stderr, "  --profile-json         the same, printed as JSON\n");
+    fprintf(stderr, "  --mem-stats            print the bytes allocated for code, lines, constants, objects etc.\n");
+    fprintf(stderr, "                         (held at exit and at the peak) and the allocation counts at exit\n");
+    fprintf(stderr, "  --cache-size <bytes>   keep compiled code for up to this many bytes (k/m/g suffixes work)\n");
+    fprintf(stderr, "                         of source seen before, so it isn't compiled again; 0 turns it off.\n");
+    fprintf(stderr, "                         Defaults to %dm for the REPL and --batch, and off otherwise\n",
+        DEFAULT_CACHE_BYTES / (1024 * 1024));
+    fprintf(stderr, "  --cache-dir <dir>      also keep the compiled code in dir as .loxc files, for later runs\n");
+    exit(64);
 }
 
 int main(int argc, const char* argv[]) {
@@ -65,15 +606,154 @@ int main(int argc, const char* argv[]) {
 
     initVM(&vm);
 
-    if (argc == 1) {
+    ProfileFormat profileFormat = PROFILE_OFF;
+    // the non-option arguments; only --compile takes more than one
+    const char** paths = ALLOCATE(MEM_OTHER, const char*, argc);
+    int pathCount = 0;
+    const char* compileOutput = NULL;
+    bool compileOnly = false;
+    const char* batchSource = NULL;
+    int jobs = availableCores();
+    // -1 until --cache-size says otherwise
+    long long cacheSize = -1;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+
+        if (strcmp(arg, "--gc-grow-factor") == 0 && i + 1 < argc) {
+            char* end;
+            double factor = strtod(argv[++i], &end);
+            if (*end != '\0' || !(factor > 1.0)) {
+                fprintf(stderr, "--gc-grow-factor must be a number greater than 1.\n");
+                exit(64);
+            }
+            vm.gcGrowFactor = factor;
+        } else if (strcmp(arg, "--heap-limit") == 0 && i + 1 < argc) {
+            long long limit = parseSize(argv[++i]);
+            if (limit <= 0) {
+                fprintf(stderr, "--heap-limit must be a positive number of bytes, optionally with k, m or g after it.\n");
+                exit(64);
+            }
+            vm.heapLimit = (size_t) limit;
+        } else if (strcmp(arg, "--no-fold") == 0) {
+            vm.foldConstants = false;
+        } else if (strcmp(arg, "--no-fuse") == 0) {
+            vm.fuseInstructions = false;
+        } else if (strcmp(arg, "--opcode-pairs") == 0) {
+            vm.printOpcodePairs = true;
+        } else if (strcmp(arg, "--engine") == 0 && i + 1 < argc) {
+            const char* engine = argv[++i];
+            if (strcmp(engine, "stack") == 0) {
+                vm.engine = ENGINE_STACK;
+            } else if (strcmp(engine, "register") == 0) {
+                vm.engine = ENGINE_REGISTER;
+            } else {
+                fprintf(stderr, "--engine must be \"stack\" or \"register\".\n");
+                exit(64);
+            }
+        } else if (strcmp(arg, "--dump-code") == 0) {
+            vm.dumpCode = true;
+        } else if (strcmp(arg, "--trace") == 0) {
+            vm.trace = true;
+        } else if (strcmp(arg, "--trace-stack") == 0) {
+            vm.trace = true;
+            vm.traceStack = true;
+        } else if (strcmp(arg, "--stats") == 0) {
+            vm.collectStats = true;
+        } else if (strcmp(arg, "--profile") == 0) {
+            profileFormat = PROFILE_TABLE;
+        } else if (strcmp(arg, "--profile-json") == 0) {
+            profileFormat = PROFILE_JSON;
+        } else if (strcmp(arg, "--mem-stats") == 0) {
+            atexit(printMemoryStatsAtExit);
+        } else if (strcmp(arg, "--compile") == 0) {
+            compileOnly = true;
+        } else if (strcmp(arg, "--cache-size") == 0 && i + 1 < argc) {
+            cacheSize = parseSize(argv[++i]);
+            if (cacheSize < 0) {
+                fprintf(stderr, "--cache-size must be a number of bytes, optionally with k, m or g after it.\n");
+                exit(64);
+            }
+        } else if (strcmp(arg, "--cache-dir") == 0 && i + 1 < argc) {
+            vm.cache.directory = argv[++i];
+            if (mkdir(vm.cache.directory, 0777) != 0 && errno != EEXIST) {
+                fprintf(stderr, "Could not create cache directory \"%s\": %s.\n", vm.cache.directory, strerror(errno));
+                exit(74);
+            }
+        } else if (strcmp(arg, "--batch") == 0 && i + 1 < argc) {
+            batchSource = argv[++i];
+        } else if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            compileOutput = argv[++i];
+        } else if (strcmp(arg, "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) {
+                fprintf(stderr, "--jobs must be a positive number.\n");
+                exit(64);
+            }
+        } else if (arg[0] == '-') {
+            usage();
+        } else {
+            paths[pathCount++] = arg;
+        }
+    }
+
+    if (profileFormat != PROFILE_OFF && vm.trace) {
+        // the trace's printing would swamp the timings
+        fprintf(stderr, "--profile can't be combined with --trace.\n");
+        exit(64);
+    }
+    if (vm.engine == ENGINE_REGISTER && (profileFormat != PROFILE_OFF || vm.trace)) {
+        fprintf(stderr, "--profile and --trace only work on the stack engine.\n");
+        exit(64);
+    }
+
+    if (batchSource != NULL && (profileFormat != PROFILE_OFF || vm.trace || vm.dumpCode || vm.printOpcodePairs)) {
+        // these all write straight to stdout/stderr, which would scramble the batch's output
+        fprintf(stderr, "--batch can't be combined with --profile, --trace, --dump-code or --opcode-pairs.\n");
+        exit(64);
+    }
+
+    if (profileFormat != PROFILE_OFF) {
+        vm.profile = newProfile();
+        exitProfile = vm.profile;
+        exitProfileFormat = profileFormat;
+        atexit(printProfileAtExit);
+    }
+
+    // the REPL and batches are where the same source comes around again
+    if (cacheSize >= 0) {
+        vm.cache.capacity = (size_t) cacheSize;
+    } else if (batchSource != NULL || (pathCount == 0 && !compileOnly)) {
+        vm.cache.capacity = DEFAULT_CACHE_BYTES;
+    }
+
+    int status = 0;
+    if (batchSource != NULL) {
+        if (compileOnly || compileOutput != NULL || pathCount > 0) {
+            usage();
+        }
+        status = runBatch(&vm, batchSource, jobs);
+    } else if (compileOnly) {
+        if (pathCount == 0 || (compileOutput != NULL && pathCount != 1)) {
+            usage();
+        }
+        status = compileOutput != NULL
+            ? compileFile(&vm, paths[0], compileOutput)
+            : compileFiles(&vm, paths, pathCount, jobs);
+    } else if (compileOutput != NULL || pathCount > 1) {
+        usage();
+    } else if (pathCount == 0) {
         repl(&vm);
-    } else if (argc == 2) {
-        runFile(&vm, argv[1]);
+        if (vm.collectStats && cacheEnabled(&vm.cache)) {
+            fprintf(stderr, "{\"cache_entries\": %d, \"cache_bytes\": %zu", vm.cache.count, vm.cache.bytes);
+            printCacheStats(&vm.cache.stats);
+            fprintf(stderr, "}\n");
+        }
     } else {
-        fprintf(stderr, "Usage: clox [path]\n");
-        exit(64);
+        runFile(&vm, paths[0]);
     }
 
+    FREE_ARRAY(MEM_OTHER, const char*, paths, argc);
     freeVM(&vm);
-    return 0;
+    return status;
 }
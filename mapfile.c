@@ -0,0 +1,135 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapfile.h"
+
+// fprintf, unless there's nowhere to print to
+static void report(FILE* err, const char* format, ...) {
+    if (err == NULL) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vfprintf(err, format, args);
+    va_end(args);
+}
+
+// the fallback: read whatever fd gives us until EOF. Used for pipes, terminals
+// and anything else without a size we can map up front
+static bool readWhole(int fd, const char* path, MappedFile* file, FILE* err) {
+    size_t capacity = 64 * 1024;
+    size_t size = 0;
+    char* buffer = (char*) malloc(capacity);
+
+    for (;;) {
+        if (buffer == NULL) {
+            report(err, "Not enough memory to read \"%s\" (%zu bytes).\n", path, capacity);
+            return false;
+        }
+
+        // always leave room for the terminator
+        if (size + 1 == capacity) {
+            capacity *= 2;
+            char* grown = (char*) realloc(buffer, capacity);
+            if (grown == NULL) {
+                free(buffer);
+            }
+            buffer = grown;
+            continue;
+        }
+
+        ssize_t bytesRead = read(fd, buffer + size, capacity - size - 1);
+        if (bytesRead == 0) {
+            break;
+        }
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            report(err, "Could not read file \"%s\": %s.\n", path, strerror(errno));
+            free(buffer);
+            return false;
+        }
+        size += bytesRead;
+    }
+
+    buffer[size] = '\0';
+    file->data = buffer;
+    file->size = size;
+    file->mappingSize = 0;
+    return true;
+}
+
+// Maps size bytes of fd with a '\0' after them, without copying. The file's pages
+// go over the start of an anonymous zero-filled reservation that's at least one
+// byte longer than the file: the kernel zero-fills the part of the last file page
+// past EOF, and if the file ends exactly on a page boundary, the terminator is the
+// first byte of the anonymous page after it.
+static bool mapWhole(int fd, size_t size, MappedFile* file) {
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    size_t mappingSize = (size + 1 + pageSize - 1) / pageSize * pageSize;
+
+    void* reservation = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reservation == MAP_FAILED) {
+        return false;
+    }
+
+    void* data = mmap(reservation, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (data == MAP_FAILED) {
+        munmap(reservation, mappingSize);
+        return false;
+    }
+
+    // it's all just reading from front to back
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    file->data = (const char*) data;
+    file->size = size;
+    file->mappingSize = mappingSize;
+    return true;
+}
+
+bool mapFile(const char* path, MappedFile* file, FILE* err) {
+    file->data = NULL;
+    file->size = 0;
+    file->mappingSize = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        report(err, "Could not open file \"%s\": %s.\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        report(err, "Could not stat file \"%s\": %s.\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    // mmap refuses zero-length mappings, so empty files go the buffered way too
+    bool mapped = S_ISREG(info.st_mode) && info.st_size > 0 && mapWhole(fd, info.st_size, file);
+    bool ok = mapped || readWhole(fd, path, file, err);
+
+    // a mapping keeps its own reference to the file
+    close(fd);
+    return ok;
+}
+
+void unmapFile(MappedFile* file) {
+    if (file->mappingSize > 0) {
+        munmap((void*) file->data, file->mappingSize);
+    } else {
+        free((void*) file->data);
+    }
+    file->data = NULL;
+    file->size = 0;
+    file->mappingSize = 0;
+}
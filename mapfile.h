@@ -0,0 +1,22 @@
+#ifndef clox_mapfile_h
+#define clox_mapfile_h
+
+#include "common.h"
+
+// a whole file in memory, read-only, with a '\0' right after its last byte
+// (so the Scanner can run over it as is)
+typedef struct {
+    const char* data;
+    size_t size;
+    // length of the mapping, or 0 if the file couldn't be mapped and was read
+    // into a malloc'd buffer instead
+    size_t mappingSize;
+} MappedFile;
+
+// maps the file at path. Pipes and other files that can't be mapped are read
+// into a buffer instead, so this works on anything that can be read.
+// On failure, prints why to err (unless it's NULL) and returns false
+bool mapFile(const char* path, MappedFile* file, FILE* err);
+void unmapFile(MappedFile* file);
+
+#endif
@@ -1,20 +1,313 @@
+#include <stdatomic.h>
 #include <stdlib.h>
 
 #include "memory.h"
+#include "object.h"
+#include "table.h"
+#include "vm.h"
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
+#ifdef DEBUG_LOG_GC
+    #include <stdio.h>
+    #include "debug.h"
+#endif
+
+// one per category plus the total, each on a cache line of its own so threads allocating
+// different kinds of things don't fight over them
+typedef struct {
+    _Alignas(64) _Atomic size_t bytes;
+    _Atomic size_t peakBytes;
+    _Atomic uint64_t allocations;
+    _Atomic uint64_t frees;
+} SharedCounters;
+
+static SharedCounters counters[MEM_CATEGORY_COUNT + 1];
+#define TOTAL_COUNTERS (&counters[MEM_CATEGORY_COUNT])
+
+static const char* categoryNames[] = {
+    [MEM_CODE] = "code",
+    [MEM_LINES] = "lines",
+    [MEM_CONSTANTS] = "constants",
+    [MEM_OBJECTS] = "objects",
+    [MEM_TABLES] = "tables",
+    [MEM_STACK] = "stack",
+    [MEM_REGISTER_CODE] = "register code",
+    [MEM_CACHE] = "cache",
+    [MEM_GC] = "gc",
+    [MEM_OTHER] = "other",
+};
+
+// relaxed all round: these are statistics, nothing is ordered by them
+static void countResize(SharedCounters* shared, size_t oldSize, size_t newSize) {
+    if (oldSize > 0) {
+        atomic_fetch_add_explicit(&shared->frees, 1, memory_order_relaxed);
+    }
+    if (newSize > 0) {
+        atomic_fetch_add_explicit(&shared->allocations, 1, memory_order_relaxed);
+    }
+
+    if (newSize < oldSize) {
+        atomic_fetch_sub_explicit(&shared->bytes, oldSize - newSize, memory_order_relaxed);
+    } else if (newSize > oldSize) {
+        size_t bytes = atomic_fetch_add_explicit(&shared->bytes, newSize - oldSize, memory_order_relaxed)
+            + (newSize - oldSize);
+        size_t peak = atomic_load_explicit(&shared->peakBytes, memory_order_relaxed);
+        while (bytes > peak && !atomic_compare_exchange_weak_explicit(&shared->peakBytes, &peak, bytes,
+                memory_order_relaxed, memory_order_relaxed)) {
+        }
+    }
+}
+
+static void readCounters(SharedCounters* shared, MemoryCounters* snapshot) {
+    snapshot->bytes = atomic_load_explicit(&shared->bytes, memory_order_relaxed);
+    snapshot->peakBytes = atomic_load_explicit(&shared->peakBytes, memory_order_relaxed);
+    snapshot->allocations = atomic_load_explicit(&shared->allocations, memory_order_relaxed);
+    snapshot->frees = atomic_load_explicit(&shared->frees, memory_order_relaxed);
+}
+
+void readMemoryStats(MemoryStats* stats) {
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++) {
+        readCounters(&counters[i], &stats->categories[i]);
+    }
+    readCounters(TOTAL_COUNTERS, &stats->total);
+}
+
+const char* memoryCategoryName(MemoryCategory category) {
+    return categoryNames[category];
+}
+
+// reallocate, except that when realloc fails it returns NULL (and counts nothing) instead
+// of exiting
+static void* tryReallocate(MemoryCategory category, void* pointer, size_t oldSize, size_t newSize) {
+    // freeing what was never allocated (a NULL array with no capacity) isn't worth counting
+    if (pointer == NULL) {
+        oldSize = 0;
+    }
+
+    void* result = NULL;
     if (newSize == 0) {
         free(pointer);
-        return NULL;
+    } else {
+        result = realloc(pointer, newSize);
+        if (result == NULL) {
+            return NULL;
+        }
+    }
+
+    if (oldSize != 0 || newSize != 0) {
+        countResize(&counters[category], oldSize, newSize);
+        countResize(TOTAL_COUNTERS, oldSize, newSize);
     }
+    return result;
+}
 
-    void* result = realloc(pointer, newSize);
+void* reallocate(MemoryCategory category, void* pointer, size_t oldSize, size_t newSize) {
+    void* result = tryReallocate(category, pointer, oldSize, newSize);
 
-    if (result == NULL) {
+    if (result == NULL && newSize != 0) {
         // TODO: some kind of helpful log about how we can't
         // allocate memory???
         exit(1);
     }
 
     return result;
-}
\ No newline at end of file
+}
+
+void* reallocateHeap(VM* vm, void* pointer, size_t oldSize, size_t newSize) {
+    vm->bytesAllocated += newSize - oldSize;
+
+    // collect before growing, so whatever we're about to allocate can't be swept
+    if (newSize > oldSize) {
+        bool collected = false;
+#ifdef DEBUG_STRESS_GC
+        collectGarbage(vm);
+        collected = true;
+#endif
+
+        if (vm->bytesAllocated > vm->nextGC) {
+            collectGarbage(vm);
+            collected = true;
+        }
+
+        if (vm->heapLimit != 0 && vm->bytesAllocated > vm->heapLimit) {
+            // whatever a collection frees might make room
+            if (!collected) {
+                collectGarbage(vm);
+            }
+            // and the cache's other chunks may be all that keeps the rest alive. Once they're
+            // gone only the running script's objects are left, so whether it fits is up to
+            // that script alone
+            if (vm->bytesAllocated > vm->heapLimit && evictIdleChunks(vm, &vm->cache)) {
+                collectGarbage(vm);
+            }
+            if (vm->bytesAllocated > vm->heapLimit) {
+                vm->bytesAllocated -= newSize - oldSize;
+                return NULL;
+            }
+        }
+    }
+
+    void* result = tryReallocate(MEM_OBJECTS, pointer, oldSize, newSize);
+    if (result == NULL && newSize != 0) {
+        vm->bytesAllocated -= newSize - oldSize;
+    }
+    return result;
+}
+
+void markObject(VM* vm, Obj* object) {
+    if (object == NULL || object->isMarked) {
+        return;
+    }
+
+#ifdef DEBUG_LOG_GC
+    printf("%p mark ", (void*) object);
+    printValue(OBJ_VAL(object));
+    printf("\n");
+#endif
+
+    object->isMarked = true;
+
+    // the gray stack isn't heap memory; growing it must never kick off a collection
+    if (vm->grayCapacity < vm->grayCount + 1) {
+        int oldCapacity = vm->grayCapacity;
+        vm->grayCapacity = GROW_CAPACITY(oldCapacity);
+        vm->grayStack = GROW_ARRAY(MEM_GC, Obj*, vm->grayStack, oldCapacity, vm->grayCapacity);
+    }
+
+    vm->grayStack[vm->grayCount] = object;
+    vm->grayCount++;
+}
+
+void markValue(VM* vm, Value value) {
+    if (IS_OBJ(value)) {
+        markObject(vm, AS_OBJ(value));
+    }
+}
+
+void markArray(VM* vm, ValueArray* array) {
+    for (int i = 0; i < array->count; i++) {
+        markValue(vm, array->values[i]);
+    }
+}
+
+// mark everything the given (already marked) object refers to
+static void blackenObject(VM* vm, Obj* object) {
+    // nothing marks through the VM yet, but objects that hold references will
+    (void) vm;
+
+#ifdef DEBUG_LOG_GC
+    printf("%p blacken ", (void*) object);
+    printValue(OBJ_VAL(object));
+    printf("\n");
+#endif
+
+    switch (object->type) {
+        case OBJ_STRING:
+            // strings don't refer to anything
+            break;
+    }
+}
+
+static void freeObject(VM* vm, Obj* object) {
+#ifdef DEBUG_LOG_GC
+    printf("%p free type %d\n", (void*) object, object->type);
+#endif
+
+    switch (object->type) {
+        case OBJ_STRING: {
+            ObjString* string = (ObjString*) object;
+            reallocateHeap(vm, object, stringSize(string->length), 0);
+            break;
+        }
+    }
+}
+
+static void markRoots(VM* vm) {
+    for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
+        markValue(vm, *slot);
+    }
+
+    // the chunk being run, or being compiled, whose constants aren't on the stack yet
+    if (vm->chunk != NULL) {
+        markArray(vm, &vm->chunk->constants);
+    }
+
+    markChunkCache(vm, &vm->cache);
+}
+
+// vm->shortStrings is weak too, like the string table
+static void removeWhiteShortStrings(VM* vm) {
+    for (int i = 0; i < SHORT_STRINGS; i++) {
+        if (vm->shortStrings[i] != NULL && !vm->shortStrings[i]->obj.isMarked) {
+            vm->shortStrings[i] = NULL;
+        }
+    }
+}
+
+static void traceReferences(VM* vm) {
+    while (vm->grayCount > 0) {
+        vm->grayCount--;
+        Obj* object = vm->grayStack[vm->grayCount];
+        blackenObject(vm, object);
+    }
+}
+
+static void sweep(VM* vm) {
+    Obj* previous = NULL;
+    Obj* object = vm->objects;
+
+    while (object != NULL) {
+        if (object->isMarked) {
+            // survived this cycle; clear the mark for the next one
+            object->isMarked = false;
+            previous = object;
+            object = object->next;
+        } else {
+            Obj* unreached = object;
+            object = object->next;
+            if (previous != NULL) {
+                previous->next = object;
+            } else {
+                vm->objects = object;
+            }
+
+            freeObject(vm, unreached);
+        }
+    }
+}
+
+void collectGarbage(VM* vm) {
+#ifdef DEBUG_LOG_GC
+    printf("-- gc begin\n");
+    size_t before = vm->bytesAllocated;
+#endif
+
+    markRoots(vm);
+    traceReferences(vm);
+    // interned strings are weak references; drop the dead ones before they're freed
+    tableRemoveWhite(&vm->strings);
+    removeWhiteShortStrings(vm);
+    sweep(vm);
+
+    vm->nextGC = (size_t) (vm->bytesAllocated * vm->gcGrowFactor);
+
+#ifdef DEBUG_LOG_GC
+    printf("-- gc end\n");
+    printf("   collected %zu bytes (from %zu to %zu) next at %zu\n",
+        before - vm->bytesAllocated, before, vm->bytesAllocated, vm->nextGC);
+#endif
+}
+
+void freeObjects(VM* vm) {
+    Obj* object = vm->objects;
+    while (object != NULL) {
+        Obj* next = object->next;
+        freeObject(vm, object);
+        object = next;
+    }
+    vm->objects = NULL;
+
+    FREE_ARRAY(MEM_GC, Obj*, vm->grayStack, vm->grayCapacity);
+    vm->grayStack = NULL;
+    vm->grayCount = 0;
+    vm->grayCapacity = 0;
+}
@@ -2,6 +2,60 @@
 #define clox_memory_h
 
 #include "common.h"
+#include "value.h"
+
+typedef struct VM VM;
+
+// the heap size that triggers the first collection
+#ifndef GC_INITIAL_THRESHOLD
+    #define GC_INITIAL_THRESHOLD (1024 * 1024)
+#endif
+
+// after a collection, the next one is triggered once the heap has grown to this
+// multiple of what survived. This is only the default; see VM.gcGrowFactor
+#ifndef GC_HEAP_GROW_FACTOR
+    #define GC_HEAP_GROW_FACTOR 2.0
+#endif
+
+// what an allocation is for; reallocate keeps counters per category, see readMemoryStats
+typedef enum {
+    // chunk bytecode
+    MEM_CODE,
+    // chunk line tables
+    MEM_LINES,
+    // chunk constant pools (ValueArrays only hold constants) and their dedup indexes
+    MEM_CONSTANTS,
+    // garbage-collected objects, through reallocateHeap; strings are the only ones so far
+    MEM_OBJECTS,
+    // hash tables (the VM's string table)
+    MEM_TABLES,
+    // the VM's value stack
+    MEM_STACK,
+    // the register engine's translated code, and what it takes to translate it
+    MEM_REGISTER_CODE,
+    // the chunk cache's entries, buckets and paths (not the chunks it holds)
+    MEM_CACHE,
+    // the collector's gray stack
+    MEM_GC,
+    // everything else: paths and results in main, thread pool bookkeeping, profiles
+    MEM_OTHER,
+    MEM_CATEGORY_COUNT,
+} MemoryCategory;
+
+typedef struct {
+    // bytes held right now, and the most ever held at once
+    size_t bytes;
+    size_t peakBytes;
+    // blocks allocated and freed; growing or shrinking a block counts as one of each
+    uint64_t allocations;
+    uint64_t frees;
+} MemoryCounters;
+
+typedef struct {
+    MemoryCounters categories[MEM_CATEGORY_COUNT];
+    // all of them together; its peak is the peak of the sum, not the sum of the peaks
+    MemoryCounters total;
+} MemoryStats;
 
 // Not sure why this is a macro instead of a normal function but whatever
 // Given the current capacity (specified) is too little, returns the new
@@ -10,19 +64,55 @@
     ((capacity) < 8 ? 8 : (capacity) * 2)
 
 // Does the actual growing, given args:
-//  (a) the type of element in the array (used for sizing)
-//  (b) the pointer to the array (will be mutated, so the existing references will still work),
-//  (c) the oldCount (current size of the array)
-//  (d) the newCount (desired size of the array)
-#define GROW_ARRAY(type, pointer, oldCount, newCount) \
-    (type*) reallocate(pointer, sizeof(type) * (oldCount), sizeof(type) * (newCount))
+//  (a) the MemoryCategory the bytes are counted against
+//  (b) the type of element in the array (used for sizing)
+//  (c) the pointer to the array (will be mutated, so the existing references will still work),
+//  (d) the oldCount (current size of the array)
+//  (e) the newCount (desired size of the array)
+#define GROW_ARRAY(category, type, pointer, oldCount, newCount) \
+    (type*) reallocate(category, pointer, sizeof(type) * (oldCount), sizeof(type) * (newCount))
+
+#define FREE_ARRAY(category, type, pointer, oldCount) \
+    (type*) reallocate(category, pointer, sizeof(type) * (oldCount), 0)
+
+#define ALLOCATE(category, type, count) \
+    (type*) reallocate(category, NULL, 0, sizeof(type) * (count))
+
+// The HEAP_* variants are for memory owned by garbage-collected objects (the
+// objects themselves and whatever buffers they own). They are accounted against
+// the VM, and growing through them may trigger a collection first.
+#define HEAP_ALLOCATE(vm, type, count) \
+    (type*) reallocateHeap(vm, NULL, 0, sizeof(type) * (count))
+
+#define HEAP_FREE(vm, type, pointer) \
+    reallocateHeap(vm, pointer, sizeof(type), 0)
+
+#define HEAP_FREE_ARRAY(vm, type, pointer, oldCount) \
+    reallocateHeap(vm, pointer, sizeof(type) * (oldCount), 0)
+
+// oldSize has to be what the block was allocated with, or the counters drift
+void* reallocate(MemoryCategory category, void* pointer, size_t oldSize, size_t newSize);
+// Counted as MEM_OBJECTS. Unlike reallocate, this returns NULL when growing fails, so the
+// VM can report it as a runtime error: when realloc fails, or when the heap would end up
+// over vm->heapLimit even after a collection. Callers have to check
+void* reallocateHeap(VM* vm, void* pointer, size_t oldSize, size_t newSize);
+
+// A snapshot of the counters, for the whole process: every VM and thread allocates through
+// the same ones. Safe to call at any time from any thread, though with other threads
+// allocating the categories are each read at a slightly different moment
+void readMemoryStats(MemoryStats* stats);
+// "code", "lines" etc., for reports
+const char* memoryCategoryName(MemoryCategory category);
 
-#define FREE_ARRAY(type, pointer, oldCount) \
-    (type*) reallocate(pointer, sizeof(type) * oldCount, 0)
+void markObject(VM* vm, Obj* object);
+void markValue(VM* vm, Value value);
+void markArray(VM* vm, ValueArray* array);
 
-#define ALLOCATE(type, count) \
-    (type*) reallocate(NULL, 0, sizeof(type) * (count))
+// mark-sweep over everything reachable from the VM's roots (the stack and the
+// constants of the chunk being compiled or run); everything else is freed
+void collectGarbage(VM* vm);
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize);
+// frees every object the VM owns, reachable or not
+void freeObjects(VM* vm);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef clox_number_h
+#define clox_number_h
+
+#include "common.h"
+
+// enough for anything formatNumber writes, "-1.23457e-308" and "-nan" included
+#define NUMBER_BUFFER_SIZE 32
+
+// writes value to buffer exactly the way printf("%g") would (six significant digits,
+// trailing zeros dropped, an exponent outside 1e-4..1e6), null terminated, and returns
+// its length. Most numbers are done with integer arithmetic and a single scaling
+// multiply; the rest (rounding ties, very large or small magnitudes, inf and nan)
+// go to snprintf
+int formatNumber(double value, char* buffer);
+
+// the number the length chars at start spell, correctly rounded, exactly as strtod would
+// read them. They have to be a number token as the scanner makes them: digits, optionally
+// followed by a '.' and more digits. Nothing past start + length is read. Most literals
+// take one exact multiply or divide, the rest go through Eisel-Lemire (one or two 64x128
+// bit multiplies), and only what that can't decide is left to strtod
+double parseNumber(const char* start, int length);
+
+#endif
@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -5,44 +6,175 @@
 #include "object.h"
 #include "value.h"
 #include "vm.h"
+#include "writer.h"
 
-#define ALLOCATE_OBJ(type, objectType) \
-    (type*) allocateObject(sizeof(type), objectType)
-
-static Obj* allocateObject(size_t size, ObjType type) {
-    Obj* object = (Obj*) reallocate(NULL, 0, size);
+// allocates an object of the given size (at least the struct for its type). It isn't on
+// vm->objects yet, so a collection would miss it: the caller fills it in and hands it to
+// trackObject without allocating anything in between. NULL if it couldn't be allocated
+static Obj* allocateObject(VM* vm, size_t size, ObjType type) {
+    Obj* object = (Obj*) reallocateHeap(vm, NULL, 0, size);
+    if (object == NULL) {
+        return NULL;
+    }
     object->type = type;
+    object->isMarked = false;
     return object;
 }
 
-// helper function to allocate an object which is a string
-static ObjString* allocateString(char* chars, int length) {
-    ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+static void trackObject(VM* vm, Obj* object) {
+    object->next = vm->objects;
+    vm->objects = object;
+}
+
+// a string with room for length chars, for the caller to write and then pass to internString;
+// NULL if there's no room for it
+static ObjString* allocateString(VM* vm, int length) {
+    ObjString* string = (ObjString*) allocateObject(vm, stringSize(length), OBJ_STRING);
+    if (string == NULL) {
+        return NULL;
+    }
     string->length = length;
-    string->chars = chars;
+    string->chars[length] = '\0';
     return string;
 }
 
-// Like copyString, except it's not a copy; allocates a new object whose
-// data is exactly the given chars array
-ObjString* takeString(char* chars, int length) {
-    return allocateString(chars, length);
+// FNV-1a
+static uint32_t hashString(const char* key, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t) key[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+// finishes off a string from allocateString whose chars have been written: if an equal
+// string is already interned, that one is returned and this one freed; otherwise this one
+// is interned and handed to the GC
+static ObjString* internString(VM* vm, ObjString* string) {
+    uint32_t hash = hashString(string->chars, string->length);
+    ObjString* interned = tableFindString(&vm->strings, string->chars, string->length, hash);
+    if (interned != NULL) {
+        reallocateHeap(vm, string, stringSize(string->length), 0);
+        return interned;
+    }
+
+    string->hash = hash;
+    trackObject(vm, (Obj*) string);
+    tableSet(&vm->strings, string, NIL_VAL);
+    return string;
+}
+
+// strings of zero or one chars come out of vm->shortStrings, which skips hashing and the
+// table lookup for the (many) one-letter literals and results
+static ObjString* shortString(VM* vm, const char* chars, int length) {
+    ObjString** slot = &vm->shortStrings[length == 0 ? 0 : 1 + (uint8_t) chars[0]];
+    if (*slot == NULL) {
+        ObjString* string = allocateString(vm, length);
+        if (string == NULL) {
+            return NULL;
+        }
+        memcpy(string->chars, chars, length);
+        *slot = internString(vm, string);
+    }
+    return *slot;
 }
 
 // copy a string (which is not null terminated) into a null terminated string
-// which is then wrapped up as an ObjString. Caller owns the pointer.
+// which is then wrapped up as an ObjString, or return the interned string with
+// the same contents if there is one.
 // Original chars are not edited and are disjoint from the returned pointer.
-ObjString* copyString(const char* chars, int length) {
-    char* heapChars = ALLOCATE(char, length+1);
-    memcpy(heapChars, chars, length);
-    heapChars[length] = '\0';
-    return allocateString(heapChars, length);
+ObjString* copyString(VM* vm, const char* chars, int length) {
+    if (length <= 1) {
+        return shortString(vm, chars, length);
+    }
+
+    uint32_t hash = hashString(chars, length);
+    ObjString* interned = tableFindString(&vm->strings, chars, length, hash);
+    if (interned != NULL) {
+        return interned;
+    }
+
+    ObjString* string = allocateString(vm, length);
+    if (string == NULL) {
+        return NULL;
+    }
+    memcpy(string->chars, chars, length);
+    string->hash = hash;
+    trackObject(vm, (Obj*) string);
+    tableSet(&vm->strings, string, NIL_VAL);
+    return string;
+}
+
+// writes the chars of count strings end to end, starting at chars
+static char* joinChars(char* chars, Value* strings, int count) {
+    for (int i = 0; i < count; i++) {
+        ObjString* string = AS_STRING(strings[i]);
+        memcpy(chars, string->chars, string->length);
+        chars += string->length;
+    }
+    return chars;
+}
+
+// count strings, length chars between them, joined straight into the new string. NULL if
+// that's too long for a string, or can't be allocated
+static ObjString* joinStrings(VM* vm, Value* strings, int count, size_t length) {
+    if (length > INT_MAX) {
+        return NULL;
+    }
+    if (length <= 1) {
+        char chars[1];
+        joinChars(chars, strings, count);
+        return shortString(vm, chars, length);
+    }
+
+    ObjString* result = allocateString(vm, (int) length);
+    if (result == NULL) {
+        return NULL;
+    }
+    joinChars(result->chars, strings, count);
+    return internString(vm, result);
+}
+
+ObjString* concatenateStrings(VM* vm, ObjString* a, ObjString* b) {
+    Value strings[] = { OBJ_VAL(a), OBJ_VAL(b) };
+    return joinStrings(vm, strings, 2, (size_t) a->length + b->length);
+}
+
+AddResult addValues(VM* vm, Value* values, int count) {
+    if (IS_NUMBER(values[0])) {
+        double sum = AS_NUMBER(values[0]);
+        for (int i = 1; i < count; i++) {
+            if (!IS_NUMBER(values[i])) {
+                return ADD_WRONG_TYPES;
+            }
+            sum += AS_NUMBER(values[i]);
+        }
+        values[0] = NUMBER_VAL(sum);
+        return ADD_OK;
+    }
+
+    // the first operand decides: anything else fails on the first add
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        if (!IS_STRING(values[i])) {
+            return ADD_WRONG_TYPES;
+        }
+        length += AS_STRING(values[i])->length;
+    }
+
+    ObjString* result = joinStrings(vm, values, count, length);
+    if (result == NULL) {
+        return ADD_OUT_OF_MEMORY;
+    }
+    values[0] = OBJ_VAL(result);
+    return ADD_OK;
 }
 
-void printObject(Value value) {
+void writeObject(Writer* writer, Value value) {
     switch (OBJ_TYPE(value)) {
         case OBJ_STRING:
-            printf("%s", AS_CSTRING(value));
+            writeBytes(writer, AS_CSTRING(value), AS_STRING(value)->length);
             break;
     }
 }
\ No newline at end of file
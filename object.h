@@ -4,6 +4,8 @@
 #ifndef clox_object_h
 #define clox_object_h
 
+typedef struct VM VM;
+
 #define OBJ_TYPE(value)     (AS_OBJ(value)->type)
 
 #define IS_STRING(value)    isObjType(value, OBJ_STRING)
@@ -19,6 +21,10 @@ typedef enum {
 // Values which are objects have an Obj* field.
 struct Obj {
     ObjType type;
+    // set during a GC cycle if the object is reachable
+    bool isMarked;
+    // every object the VM owns is in one intrusive list, so the GC can sweep them all
+    struct Obj* next;
 };
 
 // ObjString is an "extension" of Obj
@@ -26,12 +32,39 @@ struct Obj {
 struct ObjString {
     Obj obj;
     int length;
-    char* chars;
+    // FNV-1a hash of chars, computed once when the string is made
+    uint32_t hash;
+    // the chars (null terminated) live right after the header, in the same allocation
+    char chars[];
 };
 
-ObjString* takeString(char* chars, int length);
-ObjString* copyString(const char* chars, int length);
-void printObject(Value value);
+// bytes taken by a string of the given length, header and all
+static inline size_t stringSize(int length) {
+    return sizeof(ObjString) + length + 1;
+}
+
+// what addValues made of its operands
+typedef enum {
+    ADD_OK,
+    // neither all numbers nor all strings, which is exactly when one of the pairwise adds
+    // would have failed
+    ADD_WRONG_TYPES,
+    // the string was too long, or there was no room for it (see VM.heapLimit)
+    ADD_OUT_OF_MEMORY,
+} AddResult;
+
+// every string is interned in the VM's string table, so two ObjStrings with the
+// same contents are always the same pointer.
+// Everything that makes a string returns NULL if there's no room for it (see VM.heapLimit)
+ObjString* copyString(VM* vm, const char* chars, int length);
+// a + b as a new (interned) string. a and b must be reachable by the GC, since this allocates
+ObjString* concatenateStrings(VM* vm, ObjString* a, ObjString* b);
+// Adds up count values left to right, the way a chain of + does: one pass and a single
+// allocation if they're all strings, a running sum if they're all numbers. The result
+// replaces values[0], unless it's anything but ADD_OK. The values must be reachable by
+// the GC, since this allocates
+AddResult addValues(VM* vm, Value* values, int count);
+void writeObject(Writer* writer, Value value);
 
 static inline bool isObjType(Value value, ObjType objType) {
     return IS_OBJ(value) && AS_OBJ(value)->type == objType;
@@ -0,0 +1,145 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "memory.h"
+#include "pool.h"
+
+// A worker's share of the batch: the indices [begin, end) nobody has taken yet, packed
+// into one word so the owner and thieves can both claim from it with a single CAS. The
+// owner takes from the front, thieves take the back half. A range only ever shrinks or is
+// swapped for one stolen from elsewhere, and an index can't be handed out twice, so the
+// same (begin, end) never comes back once it's been changed (no ABA).
+typedef struct {
+    _Alignas(64) _Atomic uint64_t range;
+} Deque;
+
+#define RANGE(begin, end)   (((uint64_t) (uint32_t) (begin) << 32) | (uint32_t) (end))
+#define RANGE_BEGIN(range)  ((int) ((range) >> 32))
+#define RANGE_END(range)    ((int) (uint32_t) (range))
+
+typedef struct {
+    PoolTask task;
+    void* context;
+    int threads;
+    Deque* deques;
+} Batch;
+
+typedef struct {
+    Batch* batch;
+    int worker;
+} Worker;
+
+// the next index from the front of the worker's own deque, or -1 if it's empty
+static int takeOwn(Deque* deque) {
+    uint64_t range = atomic_load(&deque->range);
+    for (;;) {
+        int begin = RANGE_BEGIN(range);
+        int end = RANGE_END(range);
+        if (begin >= end) {
+            return -1;
+        }
+        if (atomic_compare_exchange_weak(&deque->range, &range, RANGE(begin + 1, end))) {
+            return begin;
+        }
+    }
+}
+
+// moves the back half of some other worker's deque into this (empty) one. Returns false
+// once every deque is empty, which means there's nothing left that isn't already taken
+static bool steal(Batch* batch, int thief) {
+    for (int i = 1; i < batch->threads; i++) {
+        // start with the neighbour, so thieves don't all pile onto worker 0
+        Deque* victim = &batch->deques[(thief + i) % batch->threads];
+        uint64_t range = atomic_load(&victim->range);
+
+        for (;;) {
+            int begin = RANGE_BEGIN(range);
+            int end = RANGE_END(range);
+            if (begin >= end) {
+                break;
+            }
+
+            // rounding up, so a single leftover item can be stolen too
+            int middle = end - (end - begin + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &range, RANGE(begin, middle))) {
+                atomic_store(&batch->deques[thief].range, RANGE(middle, end));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void* workerMain(void* argument) {
+    Worker* worker = (Worker*) argument;
+    Batch* batch = worker->batch;
+    Deque* own = &batch->deques[worker->worker];
+
+    for (;;) {
+        int index = takeOwn(own);
+        if (index < 0) {
+            if (!steal(batch, worker->worker)) {
+                return NULL;
+            }
+            continue;
+        }
+        batch->task(batch->context, index, worker->worker);
+    }
+}
+
+void runParallel(int threads, int count, PoolTask task, void* context) {
+    if (threads > count) {
+        threads = count;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    Batch batch;
+    batch.task = task;
+    batch.context = context;
+    batch.threads = threads;
+    // aligned_alloc, since each deque gets a cache line to itself
+    batch.deques = (Deque*) aligned_alloc(_Alignof(Deque), sizeof(Deque) * threads);
+    if (batch.deques == NULL) {
+        exit(1);
+    }
+
+    Worker* workers = ALLOCATE(MEM_OTHER, Worker, threads);
+    pthread_t* handles = ALLOCATE(MEM_OTHER, pthread_t, threads);
+
+    // every worker starts out with an even, contiguous share
+    for (int i = 0; i < threads; i++) {
+        int begin = (int) ((int64_t) count * i / threads);
+        int end = (int) ((int64_t) count * (i + 1) / threads);
+        atomic_init(&batch.deques[i].range, RANGE(begin, end));
+        workers[i].batch = &batch;
+        workers[i].worker = i;
+    }
+
+    // if a thread can't be started, the ones that did (and this one) steal its share
+    int started = 1;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&handles[started], NULL, workerMain, &workers[started]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    workerMain(&workers[0]);
+
+    for (int i = 1; i < started; i++) {
+        pthread_join(handles[i], NULL);
+    }
+
+    FREE_ARRAY(MEM_OTHER, pthread_t, handles, threads);
+    FREE_ARRAY(MEM_OTHER, Worker, workers, threads);
+    free(batch.deques);
+}
+
+int availableCores(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores < 1 ? 1 : (int) cores;
+}
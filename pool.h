@@ -0,0 +1,20 @@
+#ifndef clox_pool_h
+#define clox_pool_h
+
+#include "common.h"
+
+// one unit of parallel work: item index of the batch, run on worker number worker
+// (0 <= worker < the thread count), so callers can keep per-worker state like a VM
+typedef void (*PoolTask)(void* context, int index, int worker);
+
+// Calls task(context, i, worker) for every i in [0, count), spread over `threads` threads
+// (the calling thread is worker 0), and returns once every call has. Each worker starts
+// with an even, contiguous share of the indices and works through it in order; one that runs
+// out steals the back half of another's remaining share, so uneven items still balance out.
+// The order calls happen in across workers isn't fixed, so anything ordered is up to the task.
+void runParallel(int threads, int count, PoolTask task, void* context);
+
+// how many threads the machine can run at once; at least 1
+int availableCores(void);
+
+#endif
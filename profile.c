@@ -0,0 +1,169 @@
+#include "common.h"
+#include "debug.h"
+#include "memory.h"
+#include "profile.h"
+
+// how many of the most common pairs the table shows; the JSON has all of them
+#define PROFILE_TOP_PAIRS 20
+
+Profile* newProfile(void) {
+    Profile* profile = ALLOCATE(MEM_OTHER, Profile, 1);
+    memset(profile, 0, sizeof(Profile));
+    profile->current = -1;
+
+    // the cheapest of a few back-to-back clock reads is the fixed cost every
+    // instruction's ticks include
+    uint64_t overhead = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t start = profileTicks();
+        uint64_t elapsed = profileTicks() - start;
+        if (elapsed < overhead) {
+            overhead = elapsed;
+        }
+    }
+    profile->overhead = overhead;
+
+    return profile;
+}
+
+void freeProfile(Profile* profile) {
+    FREE_ARRAY(MEM_OTHER, Profile, profile, 1);
+}
+
+void profileEndRun(Profile* profile) {
+    if (profile->current != -1) {
+        uint64_t elapsed = profileTicks() - profile->startedAt;
+        profile->ticks[profile->current] += elapsed > profile->overhead ? elapsed - profile->overhead : 0;
+    }
+    profile->current = -1;
+}
+
+static const char* slotName(int slot) {
+    return slot < OP_CODE_COUNT ? opcodeName(slot) : "OP_UNKNOWN";
+}
+
+typedef struct {
+    int slot;
+    uint64_t count;
+    uint64_t ticks;
+} OpcodeRow;
+
+typedef struct {
+    int first;
+    int second;
+    uint64_t count;
+} PairRow;
+
+static int compareOpcodeRows(const void* a, const void* b) {
+    uint64_t ticksA = ((const OpcodeRow*) a)->ticks;
+    uint64_t ticksB = ((const OpcodeRow*) b)->ticks;
+    return (ticksA < ticksB) - (ticksA > ticksB);
+}
+
+static int comparePairRows(const void* a, const void* b) {
+    uint64_t countA = ((const PairRow*) a)->count;
+    uint64_t countB = ((const PairRow*) b)->count;
+    return (countA < countB) - (countA > countB);
+}
+
+// the opcodes that ran, by ticks; returns how many
+static int opcodeRows(Profile* profile, OpcodeRow* rows) {
+    int count = 0;
+    for (int slot = 0; slot < PROFILE_SLOTS; slot++) {
+        if (profile->counts[slot] > 0) {
+            rows[count].slot = slot;
+            rows[count].count = profile->counts[slot];
+            rows[count].ticks = profile->ticks[slot];
+            count++;
+        }
+    }
+    qsort(rows, count, sizeof(OpcodeRow), compareOpcodeRows);
+    return count;
+}
+
+// the pairs that ran, most common first; returns how many
+static int pairRows(Profile* profile, PairRow* rows) {
+    int count = 0;
+    for (int first = 0; first < PROFILE_SLOTS; first++) {
+        for (int second = 0; second < PROFILE_SLOTS; second++) {
+            if (profile->pairs[first][second] > 0) {
+                rows[count].first = first;
+                rows[count].second = second;
+                rows[count].count = profile->pairs[first][second];
+                count++;
+            }
+        }
+    }
+    qsort(rows, count, sizeof(PairRow), comparePairRows);
+    return count;
+}
+
+static void totals(Profile* profile, uint64_t* instructions, uint64_t* ticks) {
+    *instructions = 0;
+    *ticks = 0;
+    for (int slot = 0; slot < PROFILE_SLOTS; slot++) {
+        *instructions += profile->counts[slot];
+        *ticks += profile->ticks[slot];
+    }
+}
+
+void printProfile(Profile* profile, FILE* out) {
+    OpcodeRow opcodes[PROFILE_SLOTS];
+    PairRow pairs[PROFILE_SLOTS * PROFILE_SLOTS];
+    int opcodeCount = opcodeRows(profile, opcodes);
+    int pairCount = pairRows(profile, pairs);
+
+    uint64_t instructions, ticks;
+    totals(profile, &instructions, &ticks);
+    // keeps the percentages finite when nothing ran
+    double instructionShare = instructions > 0 ? 100.0 / instructions : 0;
+    double tickShare = ticks > 0 ? 100.0 / ticks : 0;
+
+    fprintf(out, "== profile: %llu instructions, %llu %s (less %llu per instruction for the clock) ==\n",
+        (unsigned long long) instructions, (unsigned long long) ticks, PROFILE_TICK_UNIT,
+        (unsigned long long) profile->overhead);
+    fprintf(out, "%-22s %12s %7s %14s %7s %9s\n", "opcode", "count", "count%", PROFILE_TICK_UNIT, "time%", "per op");
+    for (int i = 0; i < opcodeCount; i++) {
+        OpcodeRow* row = &opcodes[i];
+        fprintf(out, "%-22s %12llu %6.2f%% %14llu %6.2f%% %9.1f\n",
+            slotName(row->slot),
+            (unsigned long long) row->count, row->count * instructionShare,
+            (unsigned long long) row->ticks, row->ticks * tickShare,
+            (double) row->ticks / row->count);
+    }
+
+    int shown = pairCount < PROFILE_TOP_PAIRS ? pairCount : PROFILE_TOP_PAIRS;
+    fprintf(out, "== top %d of %d opcode pairs executed ==\n", shown, pairCount);
+    for (int i = 0; i < shown; i++) {
+        fprintf(out, "%12llu  %-22s %s\n",
+            (unsigned long long) pairs[i].count, slotName(pairs[i].first), slotName(pairs[i].second));
+    }
+}
+
+void printProfileJson(Profile* profile, FILE* out) {
+    OpcodeRow opcodes[PROFILE_SLOTS];
+    PairRow pairs[PROFILE_SLOTS * PROFILE_SLOTS];
+    int opcodeCount = opcodeRows(profile, opcodes);
+    int pairCount = pairRows(profile, pairs);
+
+    uint64_t instructions, ticks;
+    totals(profile, &instructions, &ticks);
+
+    fprintf(out, "{\"unit\": \"%s\", \"clock_overhead\": %llu, \"instructions\": %llu, \"ticks\": %llu,\n",
+        PROFILE_TICK_UNIT, (unsigned long long) profile->overhead,
+        (unsigned long long) instructions, (unsigned long long) ticks);
+
+    fprintf(out, " \"opcodes\": [");
+    for (int i = 0; i < opcodeCount; i++) {
+        fprintf(out, "%s\n  {\"op\": \"%s\", \"count\": %llu, \"ticks\": %llu}", i > 0 ? "," : "",
+            slotName(opcodes[i].slot), (unsigned long long) opcodes[i].count, (unsigned long long) opcodes[i].ticks);
+    }
+    fprintf(out, "],\n");
+
+    fprintf(out, " \"pairs\": [");
+    for (int i = 0; i < pairCount; i++) {
+        fprintf(out, "%s\n  {\"first\": \"%s\", \"second\": \"%s\", \"count\": %llu}", i > 0 ? "," : "",
+            slotName(pairs[i].first), slotName(pairs[i].second), (unsigned long long) pairs[i].count);
+    }
+    fprintf(out, "]}\n");
+}
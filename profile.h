@@ -0,0 +1,69 @@
+#ifndef clox_profile_h
+#define clox_profile_h
+
+#include "common.h"
+#include "chunk.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define PROFILE_TICK_UNIT "cycles"
+#else
+    #include <time.h>
+    #define PROFILE_TICK_UNIT "ns"
+#endif
+
+// every byte past the last real opcode is counted in one "unknown" slot
+#define PROFILE_SLOTS (OP_CODE_COUNT + 1)
+
+// What --profile collects: how often each opcode and each pair of consecutive opcodes
+// ran, and the ticks (TSC cycles where there is one, nanoseconds otherwise) spent in each
+// opcode. It's filled in by the instrumented copy of the dispatch loop (see vm.c), so
+// the normal loop never pays for it. Accumulates over every run until it's freed.
+typedef struct {
+    uint64_t counts[PROFILE_SLOTS];
+    uint64_t pairs[PROFILE_SLOTS][PROFILE_SLOTS];
+    uint64_t ticks[PROFILE_SLOTS];
+
+    // the opcode currently running (-1 between runs) and the tick it started on
+    int current;
+    uint64_t startedAt;
+    // what reading the clock twice in a row costs; taken off every instruction's ticks
+    uint64_t overhead;
+} Profile;
+
+Profile* newProfile(void);
+void freeProfile(Profile* profile);
+
+static inline uint64_t profileTicks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// called right before each instruction is dispatched: closes out the one before it
+static inline void profileInstruction(Profile* profile, uint8_t opcode) {
+    uint64_t now = profileTicks();
+    int slot = opcode < OP_CODE_COUNT ? opcode : OP_CODE_COUNT;
+
+    if (profile->current != -1) {
+        uint64_t elapsed = now - profile->startedAt;
+        profile->ticks[profile->current] += elapsed > profile->overhead ? elapsed - profile->overhead : 0;
+        profile->pairs[profile->current][slot] += 1;
+    }
+    profile->counts[slot] += 1;
+    profile->current = slot;
+    profile->startedAt = now;
+}
+
+// called once a run stops, however it stopped, to close out its last instruction
+void profileEndRun(Profile* profile);
+
+// the per-opcode table (by time spent, most first) and the most common pairs
+void printProfile(Profile* profile, FILE* out);
+void printProfileJson(Profile* profile, FILE* out);
+
+#endif
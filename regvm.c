@@ -0,0 +1,358 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "debug.h"
+#include "memory.h"
+#include "object.h"
+#include "regvm.h"
+
+void initRegisterCode(RegisterCode* code) {
+    code->count = 0;
+    code->capacity = 0;
+    code->code = NULL;
+    initLinesArray(&code->lines);
+    code->constantSlots = 0;
+    code->registerCount = 0;
+}
+
+void freeRegisterCode(RegisterCode* code) {
+    FREE_ARRAY(MEM_REGISTER_CODE, RegInstruction, code->code, code->capacity);
+    freeLinesArray(&code->lines);
+    initRegisterCode(code);
+}
+
+static void emit(RegisterCode* code, int line, uint8_t op, int a, int b, int c) {
+    writeLinesArray(&code->lines, line, code->count);
+
+    if (code->capacity < code->count + 1) {
+        int oldCapacity = code->capacity;
+        code->capacity = GROW_CAPACITY(oldCapacity);
+        code->code = GROW_ARRAY(MEM_REGISTER_CODE, RegInstruction, code->code, oldCapacity, code->capacity);
+    }
+
+    code->code[code->count] = (RegInstruction) { op, a, b, c };
+    code->count += 1;
+}
+
+// Runs the stack code symbolically: instead of values, the stack holds the frame slot
+// each value lives in. Loads just push their constant's slot; everything else reads its
+// operands' slots and writes to the register for the depth its result lands at.
+void translateChunk(Chunk* chunk, RegisterCode* code) {
+    int nilSlot = chunk->constants.count;
+    int trueSlot = nilSlot + 1;
+    int falseSlot = nilSlot + 2;
+
+    code->constantSlots = chunk->constants.count + 3;
+    code->registerCount = chunk->maxStack;
+    int firstRegister = code->constantSlots;
+
+    int* stack = ALLOCATE(MEM_REGISTER_CODE, int, chunk->maxStack);
+    int depth = 0;
+
+    LineCursor cursor;
+    initLineCursor(&cursor, &chunk->lines);
+
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t opcode = chunk->code[offset];
+        uint8_t* operand = &chunk->code[offset + 1];
+        int line = advanceLineCursor(&cursor, offset);
+        // where a result lands: the depth of its first operand
+        int result;
+
+        switch (opcode) {
+            case OP_CONSTANT:       stack[depth++] = operand[0]; break;
+            case OP_CONSTANT_LONG:  stack[depth++] = (operand[0] << 16) | (operand[1] << 8) | operand[2]; break;
+            case OP_NIL:            stack[depth++] = nilSlot; break;
+            case OP_TRUE:           stack[depth++] = trueSlot; break;
+            case OP_FALSE:          stack[depth++] = falseSlot; break;
+
+            case OP_NOT:
+            case OP_NEGATE:
+                result = firstRegister + depth - 1;
+                emit(code, line, opcode, result, stack[depth - 1], 0);
+                stack[depth - 1] = result;
+                break;
+
+            case OP_ADD_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+                result = firstRegister + depth - 1;
+                emit(code, line, opcode == OP_ADD_CONSTANT ? OP_ADD : OP_MULTIPLY,
+                    result, stack[depth - 1], operand[0]);
+                stack[depth - 1] = result;
+                break;
+
+            case OP_RETURN:
+                emit(code, line, OP_RETURN, 0, stack[--depth], 0);
+                break;
+
+            case OP_CONCAT: {
+                int count = operand[0];
+                depth -= count;
+                result = firstRegister + depth;
+                // the operands have to be side by side; the ones that aren't in their
+                // register yet are constants
+                for (int i = 0; i < count; i++) {
+                    if (stack[depth + i] != result + i) {
+                        emit(code, line, OP_CONSTANT, result + i, stack[depth + i], 0);
+                    }
+                }
+                emit(code, line, OP_CONCAT, result, result, count);
+                stack[depth++] = result;
+                break;
+            }
+
+            // everything else is a binary operator
+            default:
+                depth -= 1;
+                result = firstRegister + depth - 1;
+                emit(code, line, opcode, result, stack[depth - 1], stack[depth]);
+                stack[depth - 1] = result;
+                break;
+        }
+
+        offset += instructionLength(opcode);
+    }
+
+    FREE_ARRAY(MEM_REGISTER_CODE, int, stack, chunk->maxStack);
+}
+
+// how a slot reads in a disassembly: r<n> for registers, k<n> for constants
+static void printSlot(Chunk* chunk, RegisterCode* code, int slot) {
+    if (slot >= code->constantSlots) {
+        printf(" r%-5d", slot - code->constantSlots);
+    } else if (slot >= chunk->constants.count) {
+        const char* names[] = { "nil", "true", "false" };
+        printf(" %-6s", names[slot - chunk->constants.count]);
+    } else {
+        printf(" k%-5d", slot);
+    }
+}
+
+void disassembleRegisterCode(Chunk* chunk, RegisterCode* code) {
+    printf("== register code ==\n");
+
+    LineCursor cursor;
+    initLineCursor(&cursor, &code->lines);
+    int previousLine = -1;
+
+    for (int i = 0; i < code->count; i++) {
+        RegInstruction* instruction = &code->code[i];
+        int line = advanceLineCursor(&cursor, i);
+
+        printf("%04d ", i);
+        if (line == previousLine) {
+            printf("   | ");
+        } else {
+            printf("%04d ", line);
+        }
+        previousLine = line;
+
+        printf("%-22s", opcodeName(instruction->op));
+        switch (instruction->op) {
+            case OP_RETURN:
+                printSlot(chunk, code, instruction->b);
+                break;
+            case OP_NOT:
+            case OP_NEGATE:
+            case OP_CONSTANT:
+                printSlot(chunk, code, instruction->a);
+                printSlot(chunk, code, instruction->b);
+                break;
+            case OP_CONCAT:
+                printSlot(chunk, code, instruction->a);
+                printSlot(chunk, code, instruction->b);
+                printf(" x%d", instruction->c);
+                break;
+            default:
+                printSlot(chunk, code, instruction->a);
+                printSlot(chunk, code, instruction->b);
+                printSlot(chunk, code, instruction->c);
+                break;
+        }
+        printf("\n");
+    }
+
+    printf("== %d instructions, %d constant slots, %d registers ==\n",
+        code->count, code->constantSlots, code->registerCount);
+}
+
+// the same report as the stack VM's runtimeError, for the instruction at ip
+static void registerRuntimeError(VM* vm, RegisterCode* code, RegInstruction* ip, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(vm->err, format, args);
+    va_end(args);
+    fputs("\n", vm->err);
+
+    int line = getLine(&code->lines, (int) (ip - code->code));
+    fprintf(vm->err, "[line %d] in script\n", line);
+    vm->stackTop = vm->stack;
+}
+
+InterpretResult runRegisters(VM* vm, Chunk* chunk, RegisterCode* code, uint64_t* executed) {
+    // the frame lives on the VM stack, so the GC sees all of it
+    reserveStack(vm, code->constantSlots + code->registerCount);
+    Value* frame = vm->stack;
+    if (chunk->constants.count > 0) {
+        memcpy(frame, chunk->constants.values, sizeof(Value) * chunk->constants.count);
+    }
+    frame[code->constantSlots - 3] = NIL_VAL;
+    frame[code->constantSlots - 2] = BOOL_VAL(true);
+    frame[code->constantSlots - 1] = BOOL_VAL(false);
+    for (int i = 0; i < code->registerCount; i++) {
+        frame[code->constantSlots + i] = NIL_VAL;
+    }
+    vm->stackTop = frame + code->constantSlots + code->registerCount;
+
+    RegInstruction* ip = code->code;
+    RegInstruction* instruction;
+
+    #define A   frame[instruction->a]
+    #define B   frame[instruction->b]
+    #define C   frame[instruction->c]
+
+    #define RUNTIME_ERROR(...) \
+        do { \
+            registerRuntimeError(vm, code, instruction, __VA_ARGS__); \
+            *executed = ip - code->code; \
+            return INTERPRET_RUNTIME_ERROR; \
+        } while(false)
+
+    // a = b op c on two numbers
+    #define BINARY_OP(valueType, op) \
+        do { \
+            if (!IS_NUMBER(C) || !IS_NUMBER(B)) { \
+                RUNTIME_ERROR("Operands must be numbers."); \
+            } \
+            A = valueType(AS_NUMBER(B) op AS_NUMBER(C)); \
+        } while(false)
+
+    #define NOT_BOOL_VAL(value) BOOL_VAL(!(value))
+
+    // same two loop shapes as the stack VM; see vm_run.h
+    #ifdef CLOX_COMPUTED_GOTO
+        static void* dispatchTable[OP_CODE_COUNT] = {
+            [OP_EQUAL]              = &&op_OP_EQUAL,
+            [OP_NOT_EQUAL]          = &&op_OP_NOT_EQUAL,
+            [OP_GREATER]            = &&op_OP_GREATER,
+            [OP_GREATER_EQUAL]      = &&op_OP_GREATER_EQUAL,
+            [OP_LESS]               = &&op_OP_LESS,
+            [OP_LESS_EQUAL]         = &&op_OP_LESS_EQUAL,
+            [OP_ADD]                = &&op_OP_ADD,
+            [OP_SUBTRACT]           = &&op_OP_SUBTRACT,
+            [OP_MULTIPLY]           = &&op_OP_MULTIPLY,
+            [OP_DIVIDE]             = &&op_OP_DIVIDE,
+            [OP_NOT]                = &&op_OP_NOT,
+            [OP_NEGATE]             = &&op_OP_NEGATE,
+            [OP_RETURN]             = &&op_OP_RETURN,
+            [OP_NOT_GREATER]        = &&op_OP_NOT_GREATER,
+            [OP_NOT_GREATER_EQUAL]  = &&op_OP_NOT_GREATER_EQUAL,
+            [OP_NOT_LESS]           = &&op_OP_NOT_LESS,
+            [OP_NOT_LESS_EQUAL]     = &&op_OP_NOT_LESS_EQUAL,
+            [OP_CONSTANT]           = &&op_OP_CONSTANT,
+            [OP_CONCAT]             = &&op_OP_CONCAT,
+        };
+
+        #define DISPATCH() \
+            do { \
+                instruction = ip++; \
+                goto *dispatchTable[instruction->op]; \
+            } while(false)
+
+        #define CASE(op)    op_##op:
+        #define NEXT        DISPATCH()
+
+        DISPATCH();
+        {
+    #else
+        #define CASE(op)    case op:
+        #define NEXT        break
+
+        for (;;) {
+            instruction = ip++;
+            switch (instruction->op) {
+    #endif
+            CASE(OP_RETURN) {
+                writeValue(&vm->out, B);
+                writeChar(&vm->out, '\n');
+                vm->stackTop = vm->stack;
+                *executed = ip - code->code;
+                return INTERPRET_OK;
+            }
+
+            CASE(OP_EQUAL)              A = BOOL_VAL(valuesEqual(B, C));    NEXT;
+            CASE(OP_NOT_EQUAL)          A = BOOL_VAL(!valuesEqual(B, C));   NEXT;
+
+            CASE(OP_GREATER)            BINARY_OP(BOOL_VAL, >);             NEXT;
+            CASE(OP_GREATER_EQUAL)      BINARY_OP(BOOL_VAL, >=);            NEXT;
+            CASE(OP_LESS)               BINARY_OP(BOOL_VAL, <);             NEXT;
+            CASE(OP_LESS_EQUAL)         BINARY_OP(BOOL_VAL, <=);            NEXT;
+            CASE(OP_NOT_GREATER)        BINARY_OP(NOT_BOOL_VAL, >);         NEXT;
+            CASE(OP_NOT_GREATER_EQUAL)  BINARY_OP(NOT_BOOL_VAL, >=);        NEXT;
+            CASE(OP_NOT_LESS)           BINARY_OP(NOT_BOOL_VAL, <);         NEXT;
+            CASE(OP_NOT_LESS_EQUAL)     BINARY_OP(NOT_BOOL_VAL, <=);        NEXT;
+
+            CASE(OP_NEGATE) {
+                if (!IS_NUMBER(B)) {
+                    RUNTIME_ERROR("Operand must be a number.");
+                }
+                A = NUMBER_VAL(-AS_NUMBER(B));
+                NEXT;
+            }
+            CASE(OP_NOT)                A = BOOL_VAL(isFalsey(B));          NEXT;
+
+            CASE(OP_ADD) {
+                if (IS_STRING(B) && IS_STRING(C)) {
+                    // both operands are in the frame, so they stay rooted while this allocates
+                    ObjString* result = concatenateStrings(vm, AS_STRING(B), AS_STRING(C));
+                    if (result == NULL) {
+                        RUNTIME_ERROR("Out of memory.");
+                    }
+                    A = OBJ_VAL(result);
+                } else if (IS_NUMBER(B) && IS_NUMBER(C)) {
+                    A = NUMBER_VAL(AS_NUMBER(B) + AS_NUMBER(C));
+                } else {
+                    RUNTIME_ERROR("Operands must be two strings or two numbers");
+                }
+                NEXT;
+            }
+            CASE(OP_SUBTRACT)           BINARY_OP(NUMBER_VAL, -);           NEXT;
+            CASE(OP_MULTIPLY)           BINARY_OP(NUMBER_VAL, *);           NEXT;
+            CASE(OP_DIVIDE)             BINARY_OP(NUMBER_VAL, /);           NEXT;
+
+            CASE(OP_CONSTANT)           A = B;                              NEXT;
+            CASE(OP_CONCAT) {
+                // the operands are registers, so they stay rooted while this allocates
+                AddResult added = addValues(vm, &B, instruction->c);
+                if (added != ADD_OK) {
+                    RUNTIME_ERROR(added == ADD_WRONG_TYPES
+                        ? "Operands must be two strings or two numbers" : "Out of memory.");
+                }
+                NEXT;
+            }
+
+    #ifdef CLOX_COMPUTED_GOTO
+        }
+    #else
+                default:
+                    // translateChunk only emits the opcodes above
+                #ifdef __GNUC__
+                    __builtin_unreachable();
+                #else
+                    return INTERPRET_COMPILE_ERROR;
+                #endif
+            }
+        }
+    #endif
+
+    #undef CASE
+    #undef NEXT
+    #undef DISPATCH
+    #undef NOT_BOOL_VAL
+    #undef BINARY_OP
+    #undef RUNTIME_ERROR
+    #undef C
+    #undef B
+    #undef A
+}
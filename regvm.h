@@ -0,0 +1,51 @@
+#ifndef clox_regvm_h
+#define clox_regvm_h
+
+#include "chunk.h"
+#include "vm.h"
+
+// The register engine: a verified stack chunk is translated into three-address code,
+// and run by a loop of its own.
+//
+// Every operand is an index into one frame of Values laid out as
+//   [ the chunk's constants | nil | true | false | registers ]
+// so a constant operand costs the same as a register one, and loading a constant costs
+// no instruction at all. Register d holds what the stack VM would have at depth d.
+//
+// Instructions reuse the stack opcodes for what they do (OP_ADD is a = b + c, OP_NEGATE
+// is a = -b, OP_RETURN prints b); the superinstructions and the loads disappear. The one
+// exception is OP_CONCAT, a = b + ... over the c registers from b on, whose constant
+// operands are copied into their registers first with OP_CONSTANT (a = b).
+typedef struct {
+    uint8_t op;
+    // destination slot
+    int a;
+    // operand slots; c is unused by the unary operators
+    int b;
+    int c;
+} RegInstruction;
+
+typedef struct {
+    int count;
+    int capacity;
+    RegInstruction* code;
+    // keyed by instruction index, rather than code byte
+    LineRecordArray lines;
+    // frame slots before the first register: constants, then nil, true and false
+    int constantSlots;
+    int registerCount;
+} RegisterCode;
+
+void initRegisterCode(RegisterCode* code);
+void freeRegisterCode(RegisterCode* code);
+
+// chunk must have passed verifyChunk
+void translateChunk(Chunk* chunk, RegisterCode* code);
+
+void disassembleRegisterCode(Chunk* chunk, RegisterCode* code);
+
+// runs code, whose constants come from chunk; vm->chunk must be chunk. Sets *executed to
+// the number of instructions run
+InterpretResult runRegisters(VM* vm, Chunk* chunk, RegisterCode* code, uint64_t* executed);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "common.h"
 #include "scanner.h"
+#include "simdscan.h"
 
 void initScanner(Scanner* scanner, const char* source) {
     scanner->start = source;
@@ -65,6 +66,7 @@ static char peekNext(Scanner* scanner) {
 
 // skips whitespace
 // skips comments too, whatever
+// the runs themselves are skipped in bulk; see simdscan.h
 static void skipWhitespace(Scanner* scanner) {
     for (;;) {
         char c = peek(scanner);
@@ -72,17 +74,13 @@ static void skipWhitespace(Scanner* scanner) {
             case ' ':
             case '\r':
             case '\t':
-                advance(scanner);
-                break;
             case '\n':
-                scanner->line += 1;
-                advance(scanner);
+                scanner->current = skipBlanks(scanner->current, &scanner->line);
                 break;
             case '/':
                 if (peekNext(scanner) == '/') {
-                    while (peek(scanner) != '\n' && !isAtEnd(scanner)) {
-                        advance(scanner);
-                    }
+                    // leaves the newline for skipBlanks, which counts it
+                    scanner->current = skipToLineEnd(scanner->current);
                 } else {
                     // / wasn't whitespace, bail
                     return;
@@ -99,12 +97,7 @@ static void skipWhitespace(Scanner* scanner) {
 // PRE: the starting " has been consumed
 static Token string(Scanner* scanner) {
     // TODO: what about escaped quotes?
-    while (peek(scanner) != '"' && !isAtEnd(scanner)) {
-        if (peek(scanner) == '\n') {
-            scanner->line += 1;
-        }
-        advance(scanner);
-    }
+    scanner->current = skipStringBody(scanner->current, &scanner->line);
 
     if (isAtEnd(scanner)) {
         return errorToken(scanner, "Unterminated string.");
@@ -119,17 +112,13 @@ static bool isDigit(char c) {
 }
 
 static Token number(Scanner* scanner) {
-    while (isDigit(peek(scanner))) {
-        advance(scanner);
-    }
+    scanner->current = skipDigits(scanner->current);
 
     if (peek(scanner) == '.' && isDigit(peekNext(scanner))) {
         advance(scanner); // consume the dot
 
         // then consume the decimal parts
-        while (isDigit(peek(scanner))) {
-            advance(scanner);
-        }
+        scanner->current = skipDigits(scanner->current);
     }
 
     return makeToken(scanner, TOKEN_NUMBER);
@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "mapfile.h"
+#include "memory.h"
+#include "object.h"
+#include "serialize.h"
+#include "verify.h"
+
+// every section starts at a multiple of this, so it can be used in place once mapped
+#define LOXC_ALIGN 8
+
+static uint32_t alignUp(uint32_t offset) {
+    return (offset + LOXC_ALIGN - 1) & ~(uint32_t) (LOXC_ALIGN - 1);
+}
+
+// FNV-1a, 64 bit
+static uint64_t checksum(const uint8_t* bytes, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool saveChunk(Chunk* chunk, const char* path) {
+    ValueArray* constants = &chunk->constants;
+
+    uint32_t stringsLength = 0;
+    for (int i = 0; i < constants->count; i++) {
+        if (IS_STRING(constants->values[i])) {
+            stringsLength += AS_STRING(constants->values[i])->length;
+        }
+    }
+
+    LoxcHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOXC_MAGIC, sizeof(header.magic));
+    header.version = LOXC_VERSION;
+    header.byteOrder = LOXC_BYTE_ORDER;
+
+    header.codeOffset = alignUp(sizeof(LoxcHeader));
+    header.codeLength = chunk->count;
+    header.linesOffset = alignUp(header.codeOffset + header.codeLength);
+    header.linesCount = chunk->lines.count;
+    header.constantsOffset = alignUp(header.linesOffset + header.linesCount * sizeof(LineRecord));
+    header.constantsCount = constants->count;
+    header.stringsOffset = header.constantsOffset + header.constantsCount * sizeof(LoxcConstant);
+    header.stringsLength = stringsLength;
+
+    size_t size = header.stringsOffset + header.stringsLength;
+    uint8_t* image = (uint8_t*) calloc(size, 1);
+    if (image == NULL) {
+        fprintf(stderr, "Not enough memory to serialize \"%s\" (%zu bytes).\n", path, size);
+        return false;
+    }
+
+    if (chunk->count > 0) {
+        memcpy(image + header.codeOffset, chunk->code, chunk->count);
+    }
+    if (chunk->lines.count > 0) {
+        memcpy(image + header.linesOffset, chunk->lines.records, chunk->lines.count * sizeof(LineRecord));
+    }
+
+    LoxcConstant* records = (LoxcConstant*) (image + header.constantsOffset);
+    uint32_t stringOffset = 0;
+    for (int i = 0; i < constants->count; i++) {
+        Value value = constants->values[i];
+        LoxcConstant* record = &records[i];
+
+        if (IS_NUMBER(value)) {
+            double number = AS_NUMBER(value);
+            record->type = LOXC_NUMBER;
+            memcpy(&record->payload, &number, sizeof(double));
+        } else if (IS_STRING(value)) {
+            ObjString* string = AS_STRING(value);
+            record->type = LOXC_STRING;
+            record->length = string->length;
+            record->payload = stringOffset;
+            memcpy(image + header.stringsOffset + stringOffset, string->chars, string->length);
+            stringOffset += string->length;
+        } else if (IS_BOOL(value)) {
+            record->type = AS_BOOL(value) ? LOXC_TRUE : LOXC_FALSE;
+        } else {
+            record->type = LOXC_NIL;
+        }
+    }
+
+    header.checksum = checksum(image + sizeof(LoxcHeader), size - sizeof(LoxcHeader));
+    memcpy(image, &header, sizeof(header));
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\" for writing.\n", path);
+        free(image);
+        return false;
+    }
+
+    size_t written = fwrite(image, 1, size, file);
+    bool ok = fclose(file) == 0 && written == size;
+    free(image);
+
+    if (!ok) {
+        fprintf(stderr, "Could not write all of file \"%s\".\n", path);
+    }
+    return ok;
+}
+
+// true if [offset, offset + length) fits in a file of the given size
+static bool inBounds(uint64_t offset, uint64_t length, uint64_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+// everything about the image that can be checked before building anything from it.
+// Returns NULL if it's all fine, or what's wrong
+static const char* validateImage(const MappedFile* file, const LoxcHeader* header) {
+    if (memcmp(header->magic, LOXC_MAGIC, sizeof(header->magic)) != 0) {
+        return "not a .loxc file";
+    }
+    if (header->byteOrder != LOXC_BYTE_ORDER) {
+        return "written on a machine with a different byte order";
+    }
+    if (header->version != LOXC_VERSION) {
+        return "unsupported .loxc version";
+    }
+
+    if (!inBounds(header->codeOffset, header->codeLength, file->size)
+            || !inBounds(header->linesOffset, (uint64_t) header->linesCount * sizeof(LineRecord), file->size)
+            || !inBounds(header->constantsOffset, (uint64_t) header->constantsCount * sizeof(LoxcConstant), file->size)
+            || !inBounds(header->stringsOffset, header->stringsLength, file->size)) {
+        return "section out of bounds";
+    }
+    if (header->linesOffset % LOXC_ALIGN != 0 || header->constantsOffset % LOXC_ALIGN != 0) {
+        return "misaligned section";
+    }
+
+    if (checksum((const uint8_t*) file->data + sizeof(LoxcHeader), file->size - sizeof(LoxcHeader)) != header->checksum) {
+        return "checksum mismatch";
+    }
+
+    // the line table has to be something getLine can binary search
+    const LineRecord* lines = (const LineRecord*) (file->data + header->linesOffset);
+    for (uint32_t i = 0; i < header->linesCount; i++) {
+        bool sorted = i == 0 ? lines[i].codeIdx == 0 : lines[i].codeIdx > lines[i - 1].codeIdx;
+        if (!sorted || (uint32_t) lines[i].codeIdx >= header->codeLength) {
+            return "malformed line table";
+        }
+    }
+
+    const LoxcConstant* constants = (const LoxcConstant*) (file->data + header->constantsOffset);
+    for (uint32_t i = 0; i < header->constantsCount; i++) {
+        if (constants[i].type > LOXC_STRING) {
+            return "unknown constant type";
+        }
+        if (constants[i].type == LOXC_STRING
+                && !inBounds(constants[i].payload, constants[i].length, header->stringsLength)) {
+            return "string constant out of bounds";
+        }
+    }
+
+    // the code itself is checked by verifyChunk, once the constants it refers to exist
+
+    return NULL;
+}
+
+bool loadChunk(VM* vm, const char* path, Chunk* chunk, FILE* err) {
+    MappedFile file;
+    if (!mapFile(path, &file, err)) {
+        return false;
+    }
+
+    LoxcHeader header;
+    const char* problem = "truncated header";
+    if (file.size >= sizeof(LoxcHeader)) {
+        // copied out, since nothing promises the mapping is aligned for it
+        memcpy(&header, file.data, sizeof(LoxcHeader));
+        problem = validateImage(&file, &header);
+    }
+
+    if (problem != NULL) {
+        if (err != NULL) {
+            fprintf(err, "Could not load \"%s\": %s.\n", path, problem);
+        }
+        unmapFile(&file);
+        return false;
+    }
+
+    // code and lines are used in place; they're never written after compiling, so the
+    // read-only mapping is fine (and the chunk knows not to free them; see freeChunk)
+    chunk->image = (MappedFile*) malloc(sizeof(MappedFile));
+    if (chunk->image == NULL) {
+        if (err != NULL) {
+            fprintf(err, "Not enough memory to load \"%s\".\n", path);
+        }
+        unmapFile(&file);
+        return false;
+    }
+    *chunk->image = file;
+
+    chunk->code = (uint8_t*) (file.data + header.codeOffset);
+    chunk->count = header.codeLength;
+    chunk->lines.records = (LineRecord*) (file.data + header.linesOffset);
+    chunk->lines.count = header.linesCount;
+
+    // the constants are the only part that has to be built; strings go through the VM to be interned
+    Chunk* previousChunk = vm->chunk;
+    vm->chunk = chunk;
+
+    const LoxcConstant* records = (const LoxcConstant*) (file.data + header.constantsOffset);
+    const char* strings = file.data + header.stringsOffset;
+    for (uint32_t i = 0; i < header.constantsCount; i++) {
+        const LoxcConstant* record = &records[i];
+        Value value = NIL_VAL;
+
+        switch (record->type) {
+            case LOXC_NIL:      value = NIL_VAL; break;
+            case LOXC_FALSE:    value = BOOL_VAL(false); break;
+            case LOXC_TRUE:     value = BOOL_VAL(true); break;
+
+            case LOXC_NUMBER: {
+                double number;
+                memcpy(&number, &record->payload, sizeof(double));
+                value = NUMBER_VAL(number);
+                break;
+            }
+
+            case LOXC_STRING: {
+                ObjString* string = copyString(vm, strings + record->payload, record->length);
+                if (string == NULL) {
+                    problem = "out of memory for its strings";
+                    break;
+                }
+                value = OBJ_VAL(string);
+                break;
+            }
+        }
+        if (problem != NULL) {
+            break;
+        }
+
+        writeValueArray(&chunk->constants, value);
+    }
+
+    vm->chunk = previousChunk;
+
+    if (problem != NULL) {
+        if (err != NULL) {
+            fprintf(err, "Could not load \"%s\": %s.\n", path, problem);
+        }
+        freeChunk(chunk);
+        return false;
+    }
+
+    int offset;
+    problem = verifyChunk(chunk, &offset);
+    if (problem != NULL) {
+        if (err != NULL) {
+            fprintf(err, "Could not load \"%s\": %s at %04d.\n", path, problem, offset);
+        }
+        // this unmaps the file too
+        freeChunk(chunk);
+        return false;
+    }
+
+    return true;
+}
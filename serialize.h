@@ -0,0 +1,68 @@
+#ifndef clox_serialize_h
+#define clox_serialize_h
+
+#include "chunk.h"
+#include "vm.h"
+
+// On-disk format for a compiled Chunk (a .loxc file). All integers are in the byte
+// order of the machine that wrote the file, and every section starts 8-byte aligned,
+// so a loaded file is used in place: the chunk's code and line table point straight
+// into the mapping. Only the constants are rebuilt, since strings must be interned.
+//
+//   LoxcHeader
+//   code            codeLength bytes of bytecode
+//   lines           linesCount LineRecords, exactly as in LineRecordArray
+//   constants       constantsCount LoxcConstants
+//   strings         stringsLength bytes; the chars of the string constants, back to back
+#define LOXC_MAGIC      "LOXC"
+// bump this whenever the layout, or the meaning of any OP_CODE, changes
+#define LOXC_VERSION    1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    // LOXC_BYTE_ORDER as the writer saw it; anything else means the other endianness
+    uint32_t byteOrder;
+    uint32_t reserved;
+    // FNV-1a (64 bit) over everything after the header
+    uint64_t checksum;
+
+    // section offsets are from the start of the file
+    uint32_t codeOffset;
+    uint32_t codeLength;
+    uint32_t linesOffset;
+    uint32_t linesCount;
+    uint32_t constantsOffset;
+    uint32_t constantsCount;
+    uint32_t stringsOffset;
+    uint32_t stringsLength;
+} LoxcHeader;
+
+#define LOXC_BYTE_ORDER 0x01020304
+
+typedef enum {
+    LOXC_NIL,
+    LOXC_FALSE,
+    LOXC_TRUE,
+    LOXC_NUMBER,
+    LOXC_STRING,
+} LoxcConstantType;
+
+typedef struct {
+    uint32_t type;
+    // length of the string; 0 for everything else
+    uint32_t length;
+    // the bits of the double for numbers, or the offset into the strings section for strings
+    uint64_t payload;
+} LoxcConstant;
+
+// writes chunk to path. On failure, prints why to stderr and returns false
+bool saveChunk(Chunk* chunk, const char* path);
+
+// maps the .loxc file at path (see mapFile) and validates it (checksum, bounds, then the code
+// through verifyChunk) while filling in chunk, which must be freshly initialized. String
+// constants are interned into vm; chunk is vm->chunk while they are, so they stay rooted.
+// On failure, prints why to err (unless it's NULL), leaves chunk empty and returns false
+bool loadChunk(VM* vm, const char* path, Chunk* chunk, FILE* err);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef clox_sha256_h
+#define clox_sha256_h
+
+#include "common.h"
+
+#define SHA256_DIGEST_SIZE 32
+
+// SHA-256 (FIPS 180-4), fed in pieces: initSha256, updateSha256 as many times as
+// needed, then finishSha256 for the digest
+typedef struct {
+    uint32_t state[8];
+    // total bytes fed in so far
+    uint64_t length;
+    // the partial block not yet compressed, and how much of it is filled
+    uint8_t block[64];
+    size_t blockUsed;
+} Sha256;
+
+void initSha256(Sha256* sha);
+void updateSha256(Sha256* sha, const void* data, size_t length);
+void finishSha256(Sha256* sha, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif
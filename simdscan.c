@@ -0,0 +1,212 @@
+#include "common.h"
+#include "simdscan.h"
+
+#if !defined(CLOX_NO_SIMD) && defined(__AVX2__)
+    #define SIMD_AVX2
+    #include <immintrin.h>
+#elif !defined(CLOX_NO_SIMD) && defined(__SSE2__)
+    #define SIMD_SSE2
+    #include <emmintrin.h>
+#endif
+
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+
+// Reading whole aligned blocks past the '\0' is fine for the hardware but looks like
+// an overflow to AddressSanitizer, which can't know why it's safe; so it's told not to look.
+#if defined(__has_feature)
+    #if __has_feature(address_sanitizer)
+        #define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+    #endif
+#endif
+#if !defined(NO_SANITIZE_ADDRESS) && defined(__SANITIZE_ADDRESS__)
+    #define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+#ifndef NO_SANITIZE_ADDRESS
+    #define NO_SANITIZE_ADDRESS
+#endif
+
+// One vector's worth of the source, compared a byte at a time; a "mask" has bit i
+// set if byte i matched. Both instruction sets go through the same few macros.
+#ifdef SIMD_AVX2
+    #define BLOCK               32
+    typedef __m256i Block;
+    typedef uint32_t Mask;
+    #define LOAD(p)             _mm256_load_si256((const __m256i*) (p))
+    #define SPLAT(c)            _mm256_set1_epi8(c)
+    #define EQ(a, b)            _mm256_cmpeq_epi8(a, b)
+    #define OR(a, b)            _mm256_or_si256(a, b)
+    #define SUB(a, b)           _mm256_sub_epi8(a, b)
+    #define MIN_U8(a, b)        _mm256_min_epu8(a, b)
+    #define MASK(v)             ((Mask) _mm256_movemask_epi8(v))
+#else
+    #define BLOCK               16
+    typedef __m128i Block;
+    typedef uint16_t Mask;
+    #define LOAD(p)             _mm_load_si128((const __m128i*) (p))
+    #define SPLAT(c)            _mm_set1_epi8(c)
+    #define EQ(a, b)            _mm_cmpeq_epi8(a, b)
+    #define OR(a, b)            _mm_or_si128(a, b)
+    #define SUB(a, b)           _mm_sub_epi8(a, b)
+    #define MIN_U8(a, b)        _mm_min_epu8(a, b)
+    #define MASK(v)             ((Mask) _mm_movemask_epi8(v))
+#endif
+
+// the aligned block containing p. Aligned loads never cross a page boundary, which
+// is what makes reading past the '\0' safe
+#define ALIGN_DOWN(p)   ((const char*) ((uintptr_t) (p) & ~(uintptr_t) (BLOCK - 1)))
+
+// bits for the bytes before n in a block
+#define BELOW(n)        (((Mask) 1 << (n)) - 1)
+
+static inline Mask blankMask(Block v, Mask* newlines) {
+    Mask newline = MASK(EQ(v, SPLAT('\n')));
+    *newlines = newline;
+    return newline | MASK(OR(OR(EQ(v, SPLAT(' ')), EQ(v, SPLAT('\t'))), EQ(v, SPLAT('\r'))));
+}
+
+static inline Mask lineEndMask(Block v) {
+    return MASK(OR(EQ(v, SPLAT('\n')), EQ(v, SPLAT('\0'))));
+}
+
+static inline Mask stringEndMask(Block v, Mask* newlines) {
+    *newlines = MASK(EQ(v, SPLAT('\n')));
+    return MASK(OR(EQ(v, SPLAT('"')), EQ(v, SPLAT('\0'))));
+}
+
+// a byte is a digit iff (byte - '0'), as unsigned, is at most 9
+static inline Mask digitMask(Block v) {
+    Block offset = SUB(v, SPLAT('0'));
+    return MASK(EQ(MIN_U8(offset, SPLAT(9)), offset));
+}
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Each search below starts on the aligned block holding p, with the bytes before p
+// knocked out of its masks, then walks block by block until some byte ends the run.
+
+NO_SANITIZE_ADDRESS
+const char* skipBlanks(const char* p, int* line) {
+    // most runs between tokens are a single space, or nothing at all
+    if (!isBlank(p[0])) {
+        return p;
+    }
+    if (!isBlank(p[1])) {
+        *line += p[0] == '\n';
+        return p + 1;
+    }
+
+    const char* block = ALIGN_DOWN(p);
+    Mask live = ~BELOW(p - block);
+    Mask newlines;
+    Mask stops = ~blankMask(LOAD(block), &newlines) & live;
+
+    while (stops == 0) {
+        *line += __builtin_popcount(newlines & live);
+        block += BLOCK;
+        live = ~(Mask) 0;
+        stops = ~blankMask(LOAD(block), &newlines);
+    }
+
+    int stop = __builtin_ctz(stops);
+    *line += __builtin_popcount(newlines & live & BELOW(stop));
+    return block + stop;
+}
+
+NO_SANITIZE_ADDRESS
+const char* skipToLineEnd(const char* p) {
+    const char* block = ALIGN_DOWN(p);
+    Mask stops = lineEndMask(LOAD(block)) & ~BELOW(p - block);
+
+    while (stops == 0) {
+        block += BLOCK;
+        stops = lineEndMask(LOAD(block));
+    }
+    return block + __builtin_ctz(stops);
+}
+
+NO_SANITIZE_ADDRESS
+const char* skipStringBody(const char* p, int* line) {
+    const char* block = ALIGN_DOWN(p);
+    Mask live = ~BELOW(p - block);
+    Mask newlines;
+    Mask stops = stringEndMask(LOAD(block), &newlines) & live;
+
+    while (stops == 0) {
+        *line += __builtin_popcount(newlines & live);
+        block += BLOCK;
+        live = ~(Mask) 0;
+        stops = stringEndMask(LOAD(block), &newlines);
+    }
+
+    int stop = __builtin_ctz(stops);
+    *line += __builtin_popcount(newlines & live & BELOW(stop));
+    return block + stop;
+}
+
+NO_SANITIZE_ADDRESS
+const char* skipDigits(const char* p) {
+    // numbers in source are mostly short, so don't bother with a vector for one or two digits
+    if (*p < '0' || *p > '9') {
+        return p;
+    }
+    if (p[1] < '0' || p[1] > '9') {
+        return p + 1;
+    }
+
+    const char* block = ALIGN_DOWN(p);
+    Mask stops = ~digitMask(LOAD(block)) & ~BELOW(p - block);
+
+    while (stops == 0) {
+        block += BLOCK;
+        stops = ~digitMask(LOAD(block));
+    }
+    return block + __builtin_ctz(stops);
+}
+
+#else
+
+// the plain versions, for targets without SSE2/AVX2 (or with CLOX_NO_SIMD)
+
+const char* skipBlanks(const char* p, int* line) {
+    for (;; p++) {
+        switch (*p) {
+            case '\n':
+                *line += 1;
+                break;
+            case ' ':
+            case '\t':
+            case '\r':
+                break;
+            default:
+                return p;
+        }
+    }
+}
+
+const char* skipToLineEnd(const char* p) {
+    while (*p != '\n' && *p != '\0') {
+        p++;
+    }
+    return p;
+}
+
+const char* skipStringBody(const char* p, int* line) {
+    while (*p != '"' && *p != '\0') {
+        if (*p == '\n') {
+            *line += 1;
+        }
+        p++;
+    }
+    return p;
+}
+
+const char* skipDigits(const char* p) {
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    return p;
+}
+
+#endif
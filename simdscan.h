@@ -0,0 +1,29 @@
+#ifndef clox_simdscan_h
+#define clox_simdscan_h
+
+#include "common.h"
+
+// Fast paths for the scanner's character runs. Each one starts at p and returns a
+// pointer to the first character that ends the run; the source must be '\0' terminated,
+// and the '\0' always ends a run.
+//
+// With SSE2 or AVX2 available at compile time these look at 16 or 32 bytes per step,
+// otherwise they're plain loops. Define CLOX_NO_SIMD to force the plain loops.
+//
+// The vector versions load whole aligned blocks, so they may read a little past the
+// '\0' (never past the end of its page, so it can't fault).
+
+// spaces, tabs, carriage returns and newlines; adds the newlines skipped to *line
+const char* skipBlanks(const char* p, int* line);
+
+// the rest of a // comment: stops at the '\n' (which isn't consumed) or the end
+const char* skipToLineEnd(const char* p);
+
+// the body of a string literal: stops at the closing '"' or the end, adding the
+// newlines passed to *line
+const char* skipStringBody(const char* p, int* line);
+
+// a run of decimal digits
+const char* skipDigits(const char* p);
+
+#endif
@@ -0,0 +1,139 @@
+#include <string.h>
+
+#include "common.h"
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+#include "value.h"
+
+// grow once the table is this full; past this, probe sequences get long fast
+#define TABLE_MAX_LOAD 0.75
+
+void initTable(Table* table) {
+    table->count = 0;
+    table->capacity = 0;
+    table->entries = NULL;
+}
+
+void freeTable(Table* table) {
+    FREE_ARRAY(MEM_TABLES, Entry, table->entries, table->capacity);
+    initTable(table);
+}
+
+// finds the slot for the given key: either the one holding it, or the slot it
+// would go into (the first tombstone passed, if any, so they get reused).
+// Keys are interned, so comparing pointers is enough here.
+static Entry* findEntry(Entry* entries, int capacity, ObjString* key) {
+    uint32_t index = key->hash & (capacity - 1);
+    Entry* tombstone = NULL;
+
+    for (;;) {
+        Entry* entry = &entries[index];
+        if (entry->key == NULL) {
+            if (IS_NIL(entry->value)) {
+                // truly empty, so the key isn't here
+                return tombstone != NULL ? tombstone : entry;
+            } else if (tombstone == NULL) {
+                tombstone = entry;
+            }
+        } else if (entry->key == key) {
+            return entry;
+        }
+
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static void adjustCapacity(Table* table, int capacity) {
+    Entry* entries = ALLOCATE(MEM_TABLES, Entry, capacity);
+    for (int i = 0; i < capacity; i++) {
+        entries[i].key = NULL;
+        entries[i].value = NIL_VAL;
+    }
+
+    // the slots depend on the capacity, so everything gets reinserted from scratch
+    // (and tombstones are dropped along the way)
+    table->count = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        Entry* entry = &table->entries[i];
+        if (entry->key == NULL) {
+            continue;
+        }
+
+        Entry* dest = findEntry(entries, capacity, entry->key);
+        dest->key = entry->key;
+        dest->value = entry->value;
+        table->count++;
+    }
+
+    FREE_ARRAY(MEM_TABLES, Entry, table->entries, table->capacity);
+    table->entries = entries;
+    table->capacity = capacity;
+}
+
+bool tableSet(Table* table, ObjString* key, Value value) {
+    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
+        int capacity = GROW_CAPACITY(table->capacity);
+        adjustCapacity(table, capacity);
+    }
+
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    bool isNewKey = entry->key == NULL;
+    // a reused tombstone is already counted
+    if (isNewKey && IS_NIL(entry->value)) {
+        table->count++;
+    }
+
+    entry->key = key;
+    entry->value = value;
+    return isNewKey;
+}
+
+bool tableDelete(Table* table, ObjString* key) {
+    if (table->count == 0) {
+        return false;
+    }
+
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    if (entry->key == NULL) {
+        return false;
+    }
+
+    // leave a tombstone behind so probe sequences running through this slot still work
+    entry->key = NULL;
+    entry->value = BOOL_VAL(true);
+    return true;
+}
+
+ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash) {
+    if (table->count == 0) {
+        return NULL;
+    }
+
+    uint32_t index = hash & (table->capacity - 1);
+    for (;;) {
+        Entry* entry = &table->entries[index];
+        if (entry->key == NULL) {
+            // stop at an empty slot, but keep going past tombstones
+            if (IS_NIL(entry->value)) {
+                return NULL;
+            }
+        } else if (entry->key->hash == hash
+                && entry->key->length == length
+                && memcmp(entry->key->chars, chars, length) == 0) {
+            // cheap checks first; memcmp only runs on a real candidate
+            return entry->key;
+        }
+
+        index = (index + 1) & (table->capacity - 1);
+    }
+}
+
+void tableRemoveWhite(Table* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        Entry* entry = &table->entries[i];
+        if (entry->key != NULL && !entry->key->obj.isMarked) {
+            tableDelete(table, entry->key);
+        }
+    }
+}
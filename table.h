@@ -0,0 +1,40 @@
+#ifndef clox_table_h
+#define clox_table_h
+
+#include "common.h"
+#include "value.h"
+
+// a hash table keyed by (interned) strings, using open addressing with linear probing
+typedef struct {
+    // NULL if the slot is empty, or a tombstone if value is true
+    ObjString* key;
+    Value value;
+} Entry;
+
+typedef struct {
+    // live entries plus tombstones
+    int count;
+    // always zero or a power of two, so the probe sequence can mask instead of mod
+    int capacity;
+    Entry* entries;
+} Table;
+
+void initTable(Table* table);
+void freeTable(Table* table);
+
+// returns true if the key was not already in the table
+bool tableSet(Table* table, ObjString* key, Value value);
+
+// returns true if the key was in the table
+bool tableDelete(Table* table, ObjString* key);
+
+// looks up a string by its contents rather than by pointer; this is what interning
+// is built on, since it's how we find out whether an ObjString for some chars exists yet.
+// returns NULL if there is none
+ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash);
+
+// drops every entry whose key was not marked by the current GC cycle; this is what
+// makes the string table a weak reference, so interning alone doesn't keep a string alive
+void tableRemoveWhite(Table* table);
+
+#endif
@@ -0,0 +1,87 @@
+#!/bin/sh
+# Compiles thousands of generated sources at once under ThreadSanitizer, to show compile()
+# shares nothing between threads. Run it through `make test-compile-stress` from the repo
+# root.
+#
+# The same sources go through `--compile --jobs 8` and `--compile --jobs 1` in separate
+# directories; any race TSan sees fails the run, and every .loxc has to come out byte for
+# byte the same both ways. One source in 50 has a syntax error, so the error path runs
+# concurrently too: both runs must exit 65 and report the same errors (in any order).
+#
+# Knobs (environment): FILES (sources to generate), JOBS (threads for the parallel run).
+
+set -e
+
+FILES=${FILES:-2000}
+JOBS=${JOBS:-8}
+
+BUILD=tests/build
+PARALLEL="$BUILD/stress-parallel"
+SERIAL="$BUILD/stress-serial"
+rm -rf "$PARALLEL" "$SERIAL"
+mkdir -p "$PARALLEL" "$SERIAL"
+
+gcc -O1 -g -fsanitize=thread *.c -o "$BUILD/clox-tsan" -pthread
+
+# numbers, strings, chains of + that fold and chains that don't, over a few lines each
+awk -v files="$FILES" -v dir="$PARALLEL" 'BEGIN {
+    srand(17);
+    for (f = 0; f < files; f++) {
+        path = sprintf("%s/s%05d.lox", dir, f);
+        terms = 1 + int(rand() * 40);
+        for (t = 0; t < terms; t++) {
+            if (t > 0) printf "%s", (t % 6 == 0 ? " +\n" : " + ") > path;
+            kind = int(rand() * 5);
+            if (kind == 0) printf "%d", int(rand() * 1000) > path;
+            else if (kind == 1) printf "%.6f", rand() * 100 > path;
+            else if (kind == 2) printf "\"s%d\"", int(rand() * 50) > path;
+            else if (kind == 3) printf "(%d * %d - 1)", int(rand() * 10), int(rand() * 10) > path;
+            else printf "(\"a\" + \"b%d\")", f % 7 > path;
+        }
+        if (f % 50 == 49) printf " + (" > path;
+        printf "\n" > path;
+        close(path);
+    }
+}'
+cp "$PARALLEL"/*.lox "$SERIAL"
+
+TSAN_OPTIONS="halt_on_error=1 exitcode=66"
+export TSAN_OPTIONS
+
+# 65 is the expected outcome (the broken sources); anything else, a TSan report
+# included, stops the test
+compileAll() {
+    status=0
+    "$BUILD/clox-tsan" --compile --jobs "$1" "$2"/*.lox 2> "$2.err" || status=$?
+    if [ "$status" -ne 65 ]; then
+        cat "$2.err" >&2
+        echo "--compile --jobs $1 exited with $status, not 65" >&2
+        exit 1
+    fi
+}
+
+compileAll "$JOBS" "$PARALLEL"
+compileAll 1 "$SERIAL"
+
+for loxc in "$SERIAL"/*.loxc; do
+    if ! cmp -s "$loxc" "$PARALLEL/${loxc##*/}"; then
+        echo "${loxc##*/} differs between --jobs $JOBS and --jobs 1" >&2
+        exit 1
+    fi
+done
+
+serialCount=$(ls "$SERIAL" | grep -c '\.loxc$')
+parallelCount=$(ls "$PARALLEL" | grep -c '\.loxc$')
+if [ "$serialCount" -ne "$parallelCount" ]; then
+    echo "--jobs $JOBS wrote $parallelCount .loxc files, --jobs 1 wrote $serialCount" >&2
+    exit 1
+fi
+
+sed "s|$PARALLEL/||" "$PARALLEL.err" | sort > "$BUILD/stress-parallel.sorted"
+sed "s|$SERIAL/||" "$SERIAL.err" | sort > "$BUILD/stress-serial.sorted"
+if ! cmp -s "$BUILD/stress-parallel.sorted" "$BUILD/stress-serial.sorted"; then
+    echo "the compile errors differ between --jobs $JOBS and --jobs 1" >&2
+    exit 1
+fi
+
+echo "compile stress: $FILES sources, $parallelCount compiled identically at --jobs $JOBS and --jobs 1, no races"
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Shows that with --heap-limit, one runaway script in a --batch fails on its own and
+# leaves its neighbours alone. Run it through `make test-heap-limit` from the repo root.
+#
+# The batch is a runaway concatenation (40 copies of a 60 KB string, 2.4 MB in all)
+# between ordinary scripts, two of which hold 600 KB literals of their own. Under a 1 MB
+# limit the runaway has to stop with "Out of memory." at its line and exit 70, and every
+# other script has to print what it prints when run alone without a limit. The two big
+# literals can't both be live at once, so they only pass if the cached constants of
+# whatever a worker ran before don't count against the next script.
+#
+# It runs at --jobs 1 (every script through one worker, and its cache) and --jobs 3, on
+# both engines, under ASan and UBSan with a collection before every allocation.
+
+set -e
+
+BUILD=tests/build
+BATCH="$BUILD/heap-limit"
+rm -rf "$BATCH"
+mkdir -p "$BATCH"
+
+gcc -O1 -g -fsanitize=address,undefined -DDEBUG_STRESS_GC *.c -o "$BUILD/clox-asan" -pthread
+
+echo '1 + 2 * 3' > "$BATCH/1-before.lox"
+awk 'BEGIN { printf "\""; for (i = 0; i < 600000; i++) printf "a"; printf "\"\n" }' > "$BATCH/2-literal.lox"
+awk 'BEGIN {
+    piece = "\"";
+    for (i = 0; i < 60000; i++) piece = piece "x";
+    piece = piece "\"";
+    printf "%s", piece;
+    for (line = 0; line < 40; line++) printf "\n + (%s + \"\")", piece;
+    printf "\n";
+}' > "$BATCH/3-runaway.lox"
+awk 'BEGIN { printf "\""; for (i = 0; i < 600000; i++) printf "b"; printf "\"\n" }' > "$BATCH/4-literal.lox"
+echo '"hello" + " " + "world"' > "$BATCH/5-after.lox"
+
+# what the batch should print: each script's output alone, and the runaway's error
+expected="$BUILD/heap-limit.expected"
+: > "$expected"
+for script in "$BATCH"/*.lox; do
+    if [ "$script" = "$BATCH/3-runaway.lox" ]; then
+        printf '== %s (runtime error) ==\nOut of memory.\n[line 41] in script\n' "$script" >> "$expected"
+    else
+        echo "== $script ==" >> "$expected"
+        "$BUILD/clox-asan" "$script" >> "$expected"
+    fi
+done
+
+for engine in stack register; do
+    for jobs in 1 3; do
+        status=0
+        "$BUILD/clox-asan" --heap-limit 1m --engine "$engine" --jobs "$jobs" --batch "$BATCH" \
+            > "$BUILD/heap-limit.out" 2> "$BUILD/heap-limit.err" || status=$?
+        if [ "$status" -ne 70 ]; then
+            cat "$BUILD/heap-limit.err" >&2
+            echo "--engine $engine --jobs $jobs: exited with $status, not 70" >&2
+            exit 1
+        fi
+        if ! cmp -s "$expected" "$BUILD/heap-limit.out"; then
+            diff "$expected" "$BUILD/heap-limit.out" | cut -c1-100 >&2
+            echo "--engine $engine --jobs $jobs: the batch's output isn't what the scripts print alone" >&2
+            exit 1
+        fi
+    done
+done
+
+echo "heap limit: the runaway failed alone with \"Out of memory.\", its 4 neighbours passed, on both engines at --jobs 1 and 3"
@@ -0,0 +1,186 @@
+// Checks parseNumber against strtod on random number literals: every one has to come out
+// bit-identical. Built and run by `make test-parse-number`; not part of clox itself.
+//
+// The literals are the shapes the scanner hands the compiler (digits, optionally a '.'
+// and more digits), covering the fast paths and the slow one: short integers and
+// decimals, 17 to 40 significant digits, hundreds of digits on either side of the point,
+// long runs of leading zeros down into the subnormals, every double's shortest and full
+// expansions, and the exact midpoints between neighbouring doubles, written out in full
+// so they have to round half to even.
+//
+// Each literal is followed in memory by more characters strtod would read on ("e5x"),
+// so a parseNumber that looks past the token's length gets caught too.
+
+#include <float.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../number.h"
+
+// long enough for a midpoint's full expansion: up to 1100 fraction digits after the
+// up to 309 integer digits of the largest doubles
+#define LITERAL_MAX 1500
+
+static uint64_t randomState = 0x9E3779B97F4A7C15ull;
+static long checked = 0;
+static long mismatches = 0;
+
+// xorshift64; fixed seed, so a failure can be reproduced
+static uint64_t randomBits(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+static int randomBelow(int limit) {
+    return (int) (randomBits() % (uint64_t) limit);
+}
+
+static void check(const char* literal, int length) {
+    char token[LITERAL_MAX + 4];
+    memcpy(token, literal, length);
+    memcpy(token + length, "e5x", 4);
+
+    char terminated[LITERAL_MAX + 1];
+    memcpy(terminated, literal, length);
+    terminated[length] = '\0';
+
+    double expected = strtod(terminated, NULL);
+    double parsed = parseNumber(token, length);
+    checked++;
+
+    if (memcmp(&expected, &parsed, sizeof(double)) != 0) {
+        if (mismatches < 20) {
+            printf("%s: strtod says %.17g, parseNumber %.17g\n", terminated, expected, parsed);
+        }
+        mismatches++;
+    }
+}
+
+static int writeDigits(char* out, int count, bool nonZeroFirst) {
+    for (int i = 0; i < count; i++) {
+        out[i] = '0' + randomBelow(10);
+    }
+    if (nonZeroFirst && count > 0 && out[0] == '0') {
+        out[0] = '1' + randomBelow(9);
+    }
+    return count;
+}
+
+// a literal put together digit by digit
+static void randomLiteral(void) {
+    char literal[LITERAL_MAX];
+    int integerDigits;
+    int fractionDigits;
+    int leadingZeros = 0;
+
+    switch (randomBelow(8)) {
+        // what scripts mostly have
+        case 0: integerDigits = 1 + randomBelow(8); fractionDigits = randomBelow(8); break;
+        // past the 19 digits a uint64_t mantissa holds
+        case 1: integerDigits = 1 + randomBelow(20); fractionDigits = randomBelow(20); break;
+        // tiny: a long run of zeros after the point, into the subnormals
+        case 2:
+            integerDigits = 1;
+            fractionDigits = 1 + randomBelow(400);
+            leadingZeros = randomBelow(340);
+            break;
+        // huge, up to overflow
+        case 3: integerDigits = 1 + randomBelow(330); fractionDigits = 0; break;
+        // around 2^53, where integers stop being exact
+        case 4: integerDigits = 15 + randomBelow(6); fractionDigits = 0; break;
+        default: integerDigits = 1 + randomBelow(40); fractionDigits = randomBelow(40); break;
+    }
+
+    int length = writeDigits(literal, integerDigits, randomBelow(4) != 0);
+    if (fractionDigits > 0) {
+        literal[length++] = '.';
+        if (leadingZeros > fractionDigits) {
+            leadingZeros = fractionDigits;
+        }
+        memset(literal + length, '0', leadingZeros);
+        length += leadingZeros;
+        length += writeDigits(literal + length, fractionDigits - leadingZeros, false);
+    }
+    check(literal, length);
+}
+
+// writes value with the given number of decimals and checks it, unless printf used an
+// exponent (which isn't a literal)
+static void checkPrinted(const char* format, int precision, double value) {
+    char literal[LITERAL_MAX];
+    int length = snprintf(literal, sizeof(literal), format, precision, value);
+    if (length < (int) sizeof(literal) && strchr(literal, 'e') == NULL) {
+        check(literal, length);
+    }
+}
+
+// a random finite double written out a few ways, then the midpoint between it and the
+// next double up
+static void aroundRandomDouble(void) {
+    uint64_t bits = randomBits() & 0x7FEFFFFFFFFFFFFFull;
+    double value;
+    memcpy(&value, &bits, sizeof(double));
+
+    checkPrinted("%.*f", randomBelow(30), value);
+    checkPrinted("%.*g", 17, value);
+    checkPrinted("%.*f", 0, value);
+
+    uint64_t nextBits = bits + 1;
+    double next;
+    memcpy(&next, &nextBits, sizeof(double));
+
+    // long double's 64-bit mantissa holds the midpoint exactly on x86. Where long double
+    // is just a double this is only a literal near a double, which is still worth a check
+    long double midpoint = ((long double) value + (long double) next) / 2;
+    char literal[LITERAL_MAX];
+    int length = snprintf(literal, sizeof(literal), "%.1100Lf", midpoint);
+    if (length >= (int) sizeof(literal)) {
+        return;
+    }
+    while (length > 1 && literal[length - 1] == '0') {
+        length--;
+    }
+    if (literal[length - 1] == '.') {
+        length--;
+    }
+    check(literal, length);
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: parse_number [count]\n");
+        return 64;
+    }
+    long count = atol(argv[1]);
+
+    // the edges: zeros, 2^53 + 1 and its ties, the smallest normal, past 19 digits, and
+    // the usual 0.1 + 0.2
+    static const char* edges[] = {
+        "0", "0.0", "000", "1", "1.5", "0.1", "123.456", "0.30000000000000004",
+        "9007199254740992", "9007199254740993", "9007199254740993.0000000000001",
+        "2.2250738585072011", "2.2250738585072014",
+        "10000000000000000000000", "12345678901234567890123",
+    };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        check(edges[i], (int) strlen(edges[i]));
+    }
+    // and the largest double, the smallest subnormal and the smallest normal, in full
+    checkPrinted("%.*f", 0, DBL_MAX);
+    checkPrinted("%.*f", 1100, 4.9406564584124654e-324);
+    checkPrinted("%.*f", 1100, DBL_MIN);
+
+    for (long i = 0; i < count; i++) {
+        randomLiteral();
+        if (i % 4 == 0) {
+            aroundRandomDouble();
+        }
+    }
+
+    printf("parse number: %ld of %ld literals differ from strtod\n", mismatches, checked);
+    return mismatches == 0 ? 0 : 1;
+}
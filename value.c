@@ -5,6 +5,7 @@
 #include "memory.h"
 #include "value.h"
 #include "object.h"
+#include "writer.h"
 
 void initValueArray(ValueArray* array) {
     array->values = NULL;
@@ -16,7 +17,7 @@ void writeValueArray(ValueArray* array, Value value) {
     if (array -> capacity < array->count + 1) {
         int oldCapacity = array->capacity;
         array->capacity = GROW_CAPACITY(oldCapacity);
-        array->values = GROW_ARRAY(Value, array->values, oldCapacity, array->capacity);
+        array->values = GROW_ARRAY(MEM_CONSTANTS, Value, array->values, oldCapacity, array->capacity);
     }
 
     array->values[array->count] = value;
@@ -24,55 +25,52 @@ void writeValueArray(ValueArray* array, Value value) {
 }
 
 void freeValueArray(ValueArray* array) {
-    FREE_ARRAY(Value, array->values, array->capacity);
+    FREE_ARRAY(MEM_CONSTANTS, Value, array->values, array->capacity);
     initValueArray(array);
 }
 
 void printValue(Value value) {
-    switch (value.type) {
-        case VAL_BOOL:
-            printf(AS_BOOL(value) ? "true" : "false");
-            break;
-
-        case VAL_NIL:
-            printf("nil");
-            break;
+    Writer writer;
+    initWriter(&writer, stdout);
+    writeValue(&writer, value);
+    flushWriter(&writer);
+}
 
-        case VAL_NUMBER:
-            printf("%g", AS_NUMBER(value));
-            break;
-        
-        case VAL_OBJ:
-            printObject(value);
-            break;
+// only uses the IS_*/AS_* macros, so it works the same under either Value layout
+void writeValue(Writer* writer, Value value) {
+    if (IS_BOOL(value)) {
+        writeString(writer, AS_BOOL(value) ? "true" : "false");
+    } else if (IS_NIL(value)) {
+        writeString(writer, "nil");
+    } else if (IS_NUMBER(value)) {
+        writeNumber(writer, AS_NUMBER(value));
+    } else if (IS_OBJ(value)) {
+        writeObject(writer, value);
     }
 }
 
+bool isFalsey(Value value) {
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
 bool valuesEqual(Value a, Value b) {
-    if (a.type != b.type) {
-        return false;
+    // numbers go first and compare as doubles, so NaN != NaN under either layout
+    if (IS_NUMBER(a)) {
+        return IS_NUMBER(b) && AS_NUMBER(a) == AS_NUMBER(b);
     }
 
-    switch (a.type) {
-        case VAL_BOOL:
-            return AS_BOOL(a) == AS_BOOL(b);
-        
-        case VAL_NIL:
-            return true;
+    if (IS_BOOL(a)) {
+        return IS_BOOL(b) && AS_BOOL(a) == AS_BOOL(b);
+    }
 
-        case VAL_NUMBER:
-            return AS_NUMBER(a) == AS_NUMBER(b);
-        
-        case VAL_OBJ: {
-            ObjString* aStr = AS_STRING(a);
-            ObjString* bStr = AS_STRING(b);
+    if (IS_NIL(a)) {
+        return IS_NIL(b);
+    }
 
-            return aStr->length == bStr->length
-                && memcmp(aStr->chars, bStr->chars, aStr->length) == 0;
-        }
-        
-        default:
-            // unreachable
-            return false;
+    // strings are interned, so equal contents means the very same object
+    if (IS_OBJ(a) && IS_OBJ(b)) {
+        return AS_OBJ(a) == AS_OBJ(b);
     }
+
+    return false;
 }
\ No newline at end of file
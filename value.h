@@ -2,6 +2,59 @@
 #define clox_value_h
 
 #include "common.h"
+#include "writer.h"
+
+typedef struct Obj Obj;
+typedef struct ObjString ObjString;
+
+#ifdef NAN_BOXING
+
+// NaN boxing: every Value is one 64-bit word. Doubles are stored as themselves;
+// everything else hides in the payload of a quiet NaN, which no arithmetic ever
+// produces with these exact bits:
+//  - nil, false and true are small tags in the low bits
+//  - an Obj* also sets the sign bit and keeps the pointer in the low 48 bits
+typedef uint64_t Value;
+
+#define SIGN_BIT            ((uint64_t) 0x8000000000000000)
+#define QNAN                ((uint64_t) 0x7ffc000000000000)
+
+#define TAG_NIL             1   // 01
+#define TAG_FALSE           2   // 10
+#define TAG_TRUE            3   // 11
+
+#define FALSE_VAL           ((Value) (uint64_t) (QNAN | TAG_FALSE))
+#define TRUE_VAL            ((Value) (uint64_t) (QNAN | TAG_TRUE))
+
+#define BOOL_VAL(value)     ((value) ? TRUE_VAL : FALSE_VAL)
+#define NIL_VAL             ((Value) (uint64_t) (QNAN | TAG_NIL))
+#define NUMBER_VAL(value)   numToValue(value)
+#define OBJ_VAL(value)      ((Value) (SIGN_BIT | QNAN | (uint64_t) (uintptr_t) (value)))
+
+#define AS_BOOL(value)      ((value) == TRUE_VAL)
+#define AS_NUMBER(value)    valueToNum(value)
+#define AS_OBJ(value)       ((Obj*) (uintptr_t) ((value) & ~(SIGN_BIT | QNAN)))
+
+// false and true only differ in the lowest bit, so OR-ing it in collapses both onto TRUE_VAL
+#define IS_BOOL(value)      (((value) | 1) == TRUE_VAL)
+#define IS_NIL(value)       ((value) == NIL_VAL)
+#define IS_NUMBER(value)    (((value) & QNAN) != QNAN)
+#define IS_OBJ(value)       (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
+
+// memcpy is the sanctioned way to type-pun; it compiles down to a register move
+static inline Value numToValue(double num) {
+    Value value;
+    memcpy(&value, &num, sizeof(double));
+    return value;
+}
+
+static inline double valueToNum(Value value) {
+    double num;
+    memcpy(&num, &value, sizeof(Value));
+    return num;
+}
+
+#else
 
 typedef enum {
     VAL_BOOL,
@@ -10,9 +63,6 @@ typedef enum {
     VAL_OBJ,
 } ValueType;
 
-typedef struct Obj Obj;
-typedef struct ObjString ObjString;
-
 typedef struct {
     ValueType type;
     union {
@@ -22,12 +72,6 @@ typedef struct {
     } as;
 } Value;
 
-typedef struct {
-    int capacity;
-    int count;
-    Value* values;
-} ValueArray;
-
 #define BOOL_VAL(value)     ((Value){VAL_BOOL,      {.boolean = value}      })
 #define NIL_VAL             ((Value){VAL_NIL,       {.number = 0}           })
 #define NUMBER_VAL(value)   ((Value){VAL_NUMBER,    {.number = value}       })
@@ -42,11 +86,23 @@ typedef struct {
 #define IS_NUMBER(value)    ((value).type == VAL_NUMBER)
 #define IS_OBJ(value)       ((value).type == VAL_OBJ)
 
+#endif
+
+typedef struct {
+    int capacity;
+    int count;
+    Value* values;
+} ValueArray;
+
 void initValueArray(ValueArray* array);
 void writeValueArray(ValueArray* array, Value value);
 void freeValueArray(ValueArray* array);
 
 void printValue(Value value);
+// the same, into writer instead of straight to stdout
+void writeValue(Writer* writer, Value value);
 bool valuesEqual(Value a, Value b);
+// nil and false are falsey; everything else is truthy
+bool isFalsey(Value value);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "common.h"
+#include "verify.h"
+
+// how many values an instruction takes off the stack, and how many it puts back
+typedef struct {
+    int pops;
+    int pushes;
+} StackEffect;
+
+static StackEffect stackEffect(uint8_t* instruction) {
+    switch (instruction[0]) {
+        case OP_CONSTANT:
+        case OP_CONSTANT_LONG:
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+            return (StackEffect) { 0, 1 };
+
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_ADD_CONSTANT:
+        case OP_MULTIPLY_CONSTANT:
+            return (StackEffect) { 1, 1 };
+
+        case OP_RETURN:
+            return (StackEffect) { 1, 0 };
+
+        case OP_CONCAT:
+            return (StackEffect) { instruction[1], 1 };
+
+        // everything else is a binary operator
+        default:
+            return (StackEffect) { 2, 1 };
+    }
+}
+
+const char* verifyChunk(Chunk* chunk, int* offset) {
+    int depth = 0;
+    int maxDepth = 0;
+    bool returned = false;
+
+    for (*offset = 0; *offset < chunk->count;) {
+        uint8_t opcode = chunk->code[*offset];
+        int length = instructionLength(opcode);
+
+        if (returned) {
+            return "code after OP_RETURN";
+        }
+        if (length < 0) {
+            return "unknown opcode";
+        }
+        if (*offset + length > chunk->count) {
+            return "operand runs past the end of the code";
+        }
+
+        int constant = -1;
+        switch (opcode) {
+            case OP_CONSTANT:
+            case OP_ADD_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+                constant = chunk->code[*offset + 1];
+                break;
+            case OP_CONSTANT_LONG: {
+                uint8_t* operand = &chunk->code[*offset + 1];
+                constant = (operand[0] << 16) | (operand[1] << 8) | operand[2];
+                break;
+            }
+        }
+        if (constant >= chunk->constants.count) {
+            return "constant index out of range";
+        }
+        if (opcode == OP_CONCAT && chunk->code[*offset + 1] < 2) {
+            return "OP_CONCAT of fewer than two operands";
+        }
+
+        StackEffect effect = stackEffect(&chunk->code[*offset]);
+        if (depth < effect.pops) {
+            return "stack underflow";
+        }
+        depth += effect.pushes - effect.pops;
+        if (depth > maxDepth) {
+            maxDepth = depth;
+        }
+
+        returned = opcode == OP_RETURN;
+        *offset += length;
+    }
+
+    if (!returned) {
+        return "code doesn't end with OP_RETURN";
+    }
+
+    chunk->maxStack = maxDepth;
+    return NULL;
+}
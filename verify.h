@@ -0,0 +1,16 @@
+#ifndef clox_verify_h
+#define clox_verify_h
+
+#include "chunk.h"
+
+// Checks that a chunk is safe to run without any checks in the loop:
+//  - every byte of code is part of a real instruction, operands included
+//  - every constant operand is in the pool
+//  - nothing pops more than is on the stack
+//  - the code ends with its only OP_RETURN, so it can't run off the end
+// and works out how deep the stack gets (exact, since there are no jumps), into
+// chunk->maxStack. Returns NULL if the chunk is fine, or what's wrong with it, with
+// *offset set to the instruction at fault.
+const char* verifyChunk(Chunk* chunk, int* offset);
+
+#endif
@@ -1,12 +1,21 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "common.h"
 #include "vm.h"
 #include "debug.h"
 #include "compiler.h"
 #include "memory.h"
+#include "profile.h"
+#include "regvm.h"
+#include "verify.h"
+
+// computed goto relies on GCC's labels-as-values extension (clang supports it too)
+#if defined(CLOX_COMPUTED_GOTO) && !defined(__GNUC__)
+    #error "CLOX_COMPUTED_GOTO needs a compiler with labels-as-values; build with DISPATCH=switch"
+#endif
 
 static void resetStack(VM* vm) {
     vm->stackTop = vm->stack;
@@ -19,11 +28,43 @@ static Value peek(VM* vm, int distance);
 static void runtimeError(VM* vm, const char* format, ...);
 
 void initVM(VM* vm) {
+    vm->stack = NULL;
+    vm->stackCapacity = 0;
     resetStack(vm);
+    vm->chunk = NULL;
+    initTable(&vm->strings);
+    memset(vm->shortStrings, 0, sizeof(vm->shortStrings));
+    vm->foldConstants = true;
+    vm->fuseInstructions = true;
+    vm->engine = ENGINE_STACK;
+    initChunkCache(&vm->cache);
+    vm->printOpcodePairs = false;
+    vm->dumpCode = false;
+    vm->trace = false;
+    vm->traceStack = false;
+    vm->collectStats = false;
+    vm->profile = NULL;
+    initWriter(&vm->out, stdout);
+    vm->err = stderr;
+    memset(&vm->stats, 0, sizeof(vm->stats));
+
+    vm->objects = NULL;
+    vm->bytesAllocated = 0;
+    vm->nextGC = GC_INITIAL_THRESHOLD;
+    vm->gcGrowFactor = GC_HEAP_GROW_FACTOR;
+    vm->heapLimit = 0;
+    vm->grayCount = 0;
+    vm->grayCapacity = 0;
+    vm->grayStack = NULL;
 }
 
 void freeVM(VM* vm) {
-
+    flushOutput(vm);
+    FREE_ARRAY(MEM_STACK, Value, vm->stack, vm->stackCapacity);
+    freeChunkCache(&vm->cache);
+    freeTable(&vm->strings);
+    memset(vm->shortStrings, 0, sizeof(vm->shortStrings));
+    freeObjects(vm);
 }
 
 // turn three bytes into an integer. helper for readConstantLong
@@ -53,176 +94,214 @@ static Value readConstantLong(VM* vm) {
     return vm->chunk->constants.values[constantIdx];
 }
 
-static bool isFalsey(Value v) {
-    if (IS_NIL(v)) {
-        return true;
-    }
-    if (IS_BOOL(v) && !AS_BOOL(v)) {
-        return true;
+// false if there's no room for the result
+static bool concatenate(VM* vm) {
+    // only peek for now; the operands have to stay on the stack (and so stay
+    // reachable) until the result is allocated, since allocating can collect
+    ObjString* b = AS_STRING(peek(vm, 0));
+    ObjString* a = AS_STRING(peek(vm, 1));
+
+    ObjString* result = concatenateStrings(vm, a, b);
+    if (result == NULL) {
+        return false;
     }
-    return false;
-}
-
-static void concatenate(VM* vm) {
-    ObjString* b = AS_STRING(pop(vm));
-    ObjString* a = AS_STRING(pop(vm));
-
-    int length = a->length + b->length;
-    char* chars = ALLOCATE(char, length+1);
-    memcpy(chars, a->chars, a->length);
-    memcpy(chars + a->length, b->chars, b->length);
-    chars[length] = '\0';
-
-    ObjString* result = takeString(chars, length);
-    push(vm, OBJ_VAL(result));
-}
-
-static InterpretResult run(VM* vm) {
-
-    // an efficient helper function for taking a numerical argument and
-    // applying a unary function to it
-    #define UNARY_OP(valueType, op) \
-        do { \
-            if (!IS_NUMBER(peek(vm, 0))) { \
-                runtimeError(vm, "Operand must be a number."); \
-                return INTERPRET_RUNTIME_ERROR; \
-            } \
-            Value* aPtr = vm->stackTop - 1; \
-            double aNum = AS_NUMBER(*aPtr); \
-            *aPtr = valueType(op (aNum)); \
-        } while(false)
-
-    // an efficient helper function for taking two numerical arguments
-    // and applying a binary function to them
-    #define BINARY_OP(valueType, op) \
-        do { \
-            if (!IS_NUMBER(peek(vm, 0)) || !IS_NUMBER(peek(vm, 1))) { \
-                runtimeError(vm, "Operands must be numbers."); \
-                return INTERPRET_RUNTIME_ERROR; \
-            } \
-            double b = AS_NUMBER(pop(vm)); \
-            Value* aPtr = vm->stackTop - 1; \
-            double aVal = AS_NUMBER(*aPtr); \
-            *aPtr = valueType((aVal) op (b)); \
-        } while(false)
-
-    for(;;) {
-        #ifdef DEBUG_TRACE_EXECUTION
-            #ifdef DEBUG_TRACE_EXECUTION_PRINT_STACK
-                printf("        Stack (depth %ld): ", (vm->stackTop - vm->stack));
-                for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
-                    printf("[ ");
-                    Value value = *slot;
-                    printValue(value);
-                    printf(" ]");
-                }
-                printf("\n");
-            #endif
-
-            disassembleInstruction(vm->chunk, (int)(vm->ip - vm->chunk->code));
-        #endif
-
-        uint8_t instruction;
-        switch (instruction = read_byte(vm)) {
-            case OP_CONSTANT: {
-                Value constant = readConstant(vm);
-                push(vm, constant);
-                break;
-            }
-
-            case OP_CONSTANT_LONG: {
-                Value constant = readConstantLong(vm);
-                push(vm, constant);
-                break;
-            }
-
-            case OP_RETURN: {
-                Value val = pop(vm);
-                printValue(val);
-                printf("\n");
-                return INTERPRET_OK;
-            }
-
-            case OP_NIL:            push(vm, NIL_VAL);          break;
-            case OP_TRUE:           push(vm, BOOL_VAL(true));   break;
-            case OP_FALSE:          push(vm, BOOL_VAL(false));  break;
-
-            case OP_EQUAL: {
-                Value b = pop(vm);
-                Value* aPtr = vm->stackTop - 1;
-                *aPtr = BOOL_VAL(valuesEqual(*aPtr, b));
-                break;
-            }
-
-            case OP_NOT_EQUAL: {
-                Value b = pop(vm);
-                Value* aPtr = vm->stackTop - 1;
-                *aPtr = BOOL_VAL(!valuesEqual(*aPtr, b));
-                break;
-            }
-
-            case OP_GREATER:        BINARY_OP(BOOL_VAL, >); break;
-            case OP_GREATER_EQUAL:  BINARY_OP(BOOL_VAL, >=); break;
-            case OP_LESS:           BINARY_OP(BOOL_VAL, <); break;
-            case OP_LESS_EQUAL:     BINARY_OP(BOOL_VAL, <=); break;
-
-            case OP_NEGATE:         UNARY_OP(NUMBER_VAL, -);  break;
-            case OP_NOT: {
-                Value* aPtr = vm->stackTop - 1;
-                *aPtr = BOOL_VAL(isFalsey(*aPtr));
-                break;
-            }
-
-            case OP_ADD: {
-                Value b = peek(vm, 0);
-                Value a = peek(vm, 1);
-
-                if (IS_STRING(a) && IS_STRING(b)) {
-                    concatenate(vm);
-                } else if (IS_NUMBER(a) && IS_NUMBER(b)) {
-                    BINARY_OP(NUMBER_VAL, +);
-                } else {
-                    runtimeError(vm, "Operands must be two strings or two numbers");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                break;
-            }
-            case OP_SUBTRACT:       BINARY_OP(NUMBER_VAL, -); break;
-            case OP_MULTIPLY:       BINARY_OP(NUMBER_VAL, *); break;
-            case OP_DIVIDE:         BINARY_OP(NUMBER_VAL, /); break;
-
-            default:
-                printf("Unknown OP_CODE %0d; aborting run\n", instruction);
-                return INTERPRET_COMPILE_ERROR;
+    pop(vm);
+    vm->stackTop[-1] = OBJ_VAL(result);
+    return true;
+}
+
+// the plain loop
+#define RUN_NAME run
+#include "vm_run.h"
+
+// the same loop, feeding vm->profile before every instruction; see --profile
+#define RUN_NAME runProfiled
+#define INSTRUMENT() profileInstruction(vm->profile, *vm->ip)
+#include "vm_run.h"
+
+// prints the stack (with traceStack) and the instruction about to run
+static void traceInstruction(VM* vm) {
+    if (vm->traceStack) {
+        printf("        Stack (depth %ld): ", (vm->stackTop - vm->stack));
+        for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
+            printf("[ ");
+            printValue(*slot);
+            printf(" ]");
         }
+        printf("\n");
     }
+    disassembleInstruction(vm->chunk, (int)(vm->ip - vm->chunk->code));
+}
+
+// and again, printing every instruction as it goes; see --trace
+#define RUN_NAME runTraced
+#define INSTRUMENT() traceInstruction(vm)
+#include "vm_run.h"
 
-    #undef BINARY_OP
-    #undef UNARY_OP
+void flushOutput(VM* vm) {
+    flushWriter(&vm->out);
+}
+
+void redirectOutput(VM* vm, FILE* file) {
+    flushWriter(&vm->out);
+    vm->out.file = file;
+}
+
+uint64_t nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// there are no jumps yet, so everything from the start of the code up to ip was executed
+// exactly once; counting it afterwards means run() doesn't have to
+static uint64_t countExecuted(Chunk* chunk, uint8_t* ip) {
+    uint64_t count = 0;
+    for (uint8_t* at = chunk->code; at < ip; at += instructionLength(*at)) {
+        count += 1;
+    }
+    return count;
 }
 
 InterpretResult interpret(VM* vm, const char* source) {
+    return interpretWith(vm, source, vm->engine);
+}
+
+// interpretWith through the cache; the chunk stays with it afterwards
+static InterpretResult interpretCached(VM* vm, const char* source, ExecutionEngine engine) {
+    uint64_t compileStart = vm->collectStats ? nowNanos() : 0;
+    Chunk* chunk = compileCached(vm, source);
+    uint64_t compileNanos = vm->collectStats ? nowNanos() - compileStart : 0;
+
+    if (chunk == NULL) {
+        return INTERPRET_COMPILE_ERROR;
+    }
+
+    InterpretResult result = interpretChunkWith(vm, chunk, engine);
+    vm->stats.compileNanos += compileNanos;
+    return result;
+}
+
+InterpretResult interpretWith(VM* vm, const char* source, ExecutionEngine engine) {
+    // a chunk from the cache wasn't compiled just now, so there'd be nothing to dump
+    if (cacheEnabled(&vm->cache) && !vm->dumpCode) {
+        return interpretCached(vm, source, engine);
+    }
+
     Chunk chunk;
     initChunk(&chunk);
 
-    if (!compile(source, &chunk)) {
+    // set before compiling, so the constants compiled so far are GC roots
+    vm->chunk = &chunk;
+
+    uint64_t compileStart = vm->collectStats ? nowNanos() : 0;
+    bool compiled = compile(vm, source, &chunk);
+    uint64_t compileNanos = vm->collectStats ? nowNanos() - compileStart : 0;
+
+    if (!compiled) {
         freeChunk(&chunk);
+        vm->chunk = NULL;
         return INTERPRET_COMPILE_ERROR;
     }
 
-    vm->chunk = &chunk;
-    vm->ip = vm->chunk->code;
-
-    InterpretResult result = run(vm);
+    InterpretResult result = interpretChunkWith(vm, &chunk, engine);
+    vm->stats.compileNanos += compileNanos;
 
+    // anything only the chunk referred to is garbage now, and is picked up by the next collection
     freeChunk(&chunk);
 
     return result;
 }
 
+void reserveStack(VM* vm, int depth) {
+    if (vm->stackCapacity < depth) {
+        vm->stack = GROW_ARRAY(MEM_STACK, Value, vm->stack, vm->stackCapacity, depth);
+        vm->stackCapacity = depth;
+        resetStack(vm);
+    }
+}
+
+InterpretResult interpretChunk(VM* vm, Chunk* chunk) {
+    return interpretChunkWith(vm, chunk, vm->engine);
+}
+
+// translates the chunk and runs that; the translation counts as compile time
+static InterpretResult runOnRegisters(VM* vm, Chunk* chunk) {
+    uint64_t translateStart = vm->collectStats ? nowNanos() : 0;
+
+    RegisterCode code;
+    initRegisterCode(&code);
+    translateChunk(chunk, &code);
+    if (vm->dumpCode) {
+        disassembleRegisterCode(chunk, &code);
+    }
+
+    uint64_t runStart = vm->collectStats ? nowNanos() : 0;
+    uint64_t executed;
+    InterpretResult result = runRegisters(vm, chunk, &code, &executed);
+
+    if (vm->collectStats) {
+        vm->stats.runNanos = nowNanos() - runStart;
+        vm->stats.compileNanos = runStart - translateStart;
+        vm->stats.instructions = executed;
+    }
+
+    freeRegisterCode(&code);
+    return result;
+}
+
+InterpretResult interpretChunkWith(VM* vm, Chunk* chunk, ExecutionEngine engine) {
+    // run() trusts the code completely, so it has to have been through the verifier
+    if (chunk->maxStack < 0) {
+        int offset;
+        const char* problem = verifyChunk(chunk, &offset);
+        if (problem != NULL) {
+            fprintf(vm->err, "Refusing to run invalid bytecode at %04d: %s.\n", offset, problem);
+            return INTERPRET_COMPILE_ERROR;
+        }
+    }
+
+    if (vm->printOpcodePairs) {
+        printOpcodePairs(chunk);
+    }
+
+    vm->chunk = chunk;
+    vm->ip = chunk->code;
+
+    if (engine == ENGINE_REGISTER) {
+        InterpretResult result = runOnRegisters(vm, chunk);
+        vm->chunk = NULL;
+        return result;
+    }
+
+    reserveStack(vm, chunk->maxStack);
+
+    uint64_t runStart = vm->collectStats ? nowNanos() : 0;
+
+    InterpretResult result;
+    if (vm->trace) {
+        result = runTraced(vm);
+    } else if (vm->profile != NULL) {
+        result = runProfiled(vm);
+        profileEndRun(vm->profile);
+    } else {
+        result = run(vm);
+    }
+
+    if (vm->collectStats) {
+        vm->stats.runNanos = nowNanos() - runStart;
+        vm->stats.compileNanos = 0;
+        vm->stats.instructions = countExecuted(chunk, vm->ip);
+    }
+
+    vm->chunk = NULL;
+    return result;
+}
+
 void push(VM* vm, Value value) {
-    if (vm->stackTop >= vm->stack + STACK_MAX) {
-        fprintf(stderr, "Stack overflow -- max %d", STACK_MAX);
+    if (vm->stackTop >= vm->stack + vm->stackCapacity) {
+        flushOutput(vm);
+        fprintf(vm->err, "Stack overflow -- max %d", vm->stackCapacity);
         exit(1);
     }
     *vm->stackTop = value;
@@ -243,13 +322,13 @@ static Value peek(VM* vm, int distance) {
 static void runtimeError(VM* vm, const char* format, ...) {
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    vfprintf(vm->err, format, args);
     va_end(args);
-    fputs("\n", stderr);
+    fputs("\n", vm->err);
 
     size_t instruction = vm->ip - vm->chunk->code - 1;
     LineRecordArray* lines = &vm->chunk->lines;
     int line = getLine(lines, instruction);
-    fprintf(stderr, "[line %d] in script\n", line);
+    fprintf(vm->err, "[line %d] in script\n", line);
     resetStack(vm);
 }
\ No newline at end of file
@@ -1,12 +1,33 @@
 #ifndef clox_vm_h
 #define clox_vm_h
 
+#include "cache.h"
 #include "chunk.h"
+#include "profile.h"
+#include "table.h"
 
-#define STACK_MAX 256
+// "" and the 256 one-char strings
+#define SHORT_STRINGS (1 + UINT8_MAX + 1)
 
-// TODO: the data layout of this VM doesn't really make sense to me
+// what the last interpret()/interpretChunk() did; only filled in when collectStats is set
 typedef struct {
+    // instructions executed, up to and including the one that returned (or failed)
+    uint64_t instructions;
+    // wall time spent compiling (zero for a chunk that was loaded) and running
+    uint64_t compileNanos;
+    uint64_t runNanos;
+} RunStats;
+
+// what runs a compiled chunk
+typedef enum {
+    // the stack VM in vm_run.h
+    ENGINE_STACK,
+    // the chunk translated to three-address register code first; see regvm.h
+    ENGINE_REGISTER,
+} ExecutionEngine;
+
+// TODO: the data layout of this VM doesn't really make sense to me
+typedef struct VM {
     Chunk* chunk;
     // an actual pointer into the code array in chunk, in gross defiance
     // of all that is holy
@@ -14,9 +35,67 @@ typedef struct {
     // this is a pointer to the instruction that is _about to be_ executed
     uint8_t* ip;
     // stack is just, like, right there, hangin out
-    Value stack[STACK_MAX];
+    // sized for the deepest chunk run so far (see Chunk.maxStack), so nothing in the
+    // loop has to check for overflow
+    Value* stack;
+    int stackCapacity;
     // this is always a pointer to the next _unused_ spot in the stack.
     Value* stackTop;
+    // every live string, keyed by its contents; see copyString
+    Table strings;
+    // the empty string at 0 and each one-char string c at 1 + c, once they've been made;
+    // weak, like strings
+    ObjString* shortStrings[SHORT_STRINGS];
+
+    // compiler settings for interpret()
+    // fold constant subexpressions at compile time; on by default
+    bool foldConstants;
+    // emit superinstructions (OP_ADD_CONSTANT etc.); on by default
+    bool fuseInstructions;
+    // what interpret() and interpretChunk() run chunks on; ENGINE_STACK by default
+    ExecutionEngine engine;
+    // compiled chunks interpret() can reuse for source it's seen before; disabled by
+    // default, see --cache-size and --cache-dir
+    ChunkCache cache;
+    // print how often each pair of adjacent opcodes occurs in the compiled code
+    bool printOpcodePairs;
+    // disassemble every chunk once it's compiled; see --dump-code
+    bool dumpCode;
+
+    // debugging output while running
+    // print every instruction before it runs; runs go through a separate copy of the
+    // dispatch loop for this, so the normal one doesn't check it every instruction
+    bool trace;
+    // with trace, also print the whole stack before every instruction
+    bool traceStack;
+    // fill in stats on every run; see --stats
+    bool collectStats;
+    RunStats stats;
+    // when set, runs go through the instrumented loop and are recorded here; see --profile
+    Profile* profile;
+
+    // where a script's result goes (stdout by default), buffered: it's only written out when
+    // the buffer fills or on flushOutput. Compile and runtime errors go straight to err
+    // (stderr by default). --batch points both at a buffer per script
+    Writer out;
+    FILE* err;
+
+    // garbage collector state; see memory.c
+    // head of the list of every object this VM has allocated
+    Obj* objects;
+    // bytes currently held by objects, and the level that triggers the next collection
+    size_t bytesAllocated;
+    size_t nextGC;
+    // after a collection, nextGC is set to the surviving bytes times this (must be > 1)
+    double gcGrowFactor;
+    // bytesAllocated is never allowed past this; an allocation that would go over (after a
+    // collection, and after dropping the cache's idle chunks) fails, and the run stops with
+    // an "Out of memory." runtime error. 0 for no limit, the default; see --heap-limit
+    size_t heapLimit;
+    // worklist of marked objects whose references haven't been traced yet
+    int grayCount;
+    int grayCapacity;
+    Obj** grayStack;
 } VM;
 
 typedef enum {
@@ -29,8 +108,26 @@ void initVM(VM* vm);
 void freeVM(VM* vm);
 
 InterpretResult interpret(VM* vm, const char* source);
+// runs an already compiled (or loaded) chunk; the caller still owns it afterwards
+InterpretResult interpretChunk(VM* vm, Chunk* chunk);
+// the same, on the given engine instead of vm->engine
+InterpretResult interpretWith(VM* vm, const char* source, ExecutionEngine engine);
+InterpretResult interpretChunkWith(VM* vm, Chunk* chunk, ExecutionEngine engine);
+
+// a monotonic clock, in nanoseconds; what RunStats is measured with
+uint64_t nowNanos(void);
+
+// writes out whatever results are still buffered in vm->out
+void flushOutput(VM* vm);
+// flushes vm->out, then points it at file
+void redirectOutput(VM* vm, FILE* file);
+
+// makes room on the stack for depth values; only between runs, while it's empty
+void reserveStack(VM* vm, int depth);
 
-// TODO: what about error handling? stack over/underflow?
+// for use outside run(): exits on overflow. run() pushes unchecked, since the stack was
+// sized for the chunk
+// TODO: what about stack underflow?
 void push(VM* vm, Value value);
 Value pop(VM* vm);
 
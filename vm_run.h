@@ -0,0 +1,262 @@
+// The VM's dispatch loop. This has no include guard on purpose: vm.c includes it once per
+// copy of the loop it needs, each time with
+//  - RUN_NAME: the name of the function to define, as static InterpretResult RUN_NAME(VM* vm)
+//  - INSTRUMENT(): run before every instruction is fetched (vm->ip is on it); leave it
+//    undefined for none
+// so instrumentation lives in its own copy and the plain loop doesn't carry any of it.
+// Both are undefined again at the end.
+
+#ifndef INSTRUMENT
+    #define INSTRUMENT() do { } while(false)
+#endif
+
+static InterpretResult RUN_NAME(VM* vm) {
+
+    // an efficient helper function for taking a numerical argument and
+    // applying a unary function to it
+    #define UNARY_OP(valueType, op) \
+        do { \
+            if (!IS_NUMBER(peek(vm, 0))) { \
+                runtimeError(vm, "Operand must be a number."); \
+                return INTERPRET_RUNTIME_ERROR; \
+            } \
+            Value* aPtr = vm->stackTop - 1; \
+            double aNum = AS_NUMBER(*aPtr); \
+            *aPtr = valueType(op (aNum)); \
+        } while(false)
+
+    // an efficient helper function for taking two numerical arguments
+    // and applying a binary function to them
+    #define BINARY_OP(valueType, op) \
+        do { \
+            if (!IS_NUMBER(peek(vm, 0)) || !IS_NUMBER(peek(vm, 1))) { \
+                runtimeError(vm, "Operands must be numbers."); \
+                return INTERPRET_RUNTIME_ERROR; \
+            } \
+            double b = AS_NUMBER(pop(vm)); \
+            Value* aPtr = vm->stackTop - 1; \
+            double aVal = AS_NUMBER(*aPtr); \
+            *aPtr = valueType((aVal) op (b)); \
+        } while(false)
+
+    // for the fused compare-and-negate instructions
+    #define NOT_BOOL_VAL(value) BOOL_VAL(!(value))
+
+    // only verified chunks get here (see verifyChunk), and the stack was sized for them,
+    // so pushes don't check for overflow
+    #define PUSH(value) (*vm->stackTop++ = (value))
+
+    // The handlers below are written once and expanded into one of two dispatch loops:
+    //  - computed goto: every handler ends by jumping straight to the next handler through
+    //    its own indirect branch, which the branch predictor can learn per opcode
+    //  - switch: the portable fallback, where every opcode goes through the one switch
+    #ifdef CLOX_COMPUTED_GOTO
+        // unknown bytes all land on the same label as the switch's default case (which
+        // verified code never reaches)
+        static void* dispatchTable[256] = {
+            [0 ... 255]         = &&op_unknown,
+            [OP_CONSTANT]       = &&op_OP_CONSTANT,
+            [OP_CONSTANT_LONG]  = &&op_OP_CONSTANT_LONG,
+            [OP_NIL]            = &&op_OP_NIL,
+            [OP_TRUE]           = &&op_OP_TRUE,
+            [OP_FALSE]          = &&op_OP_FALSE,
+            [OP_EQUAL]          = &&op_OP_EQUAL,
+            [OP_NOT_EQUAL]      = &&op_OP_NOT_EQUAL,
+            [OP_GREATER]        = &&op_OP_GREATER,
+            [OP_GREATER_EQUAL]  = &&op_OP_GREATER_EQUAL,
+            [OP_LESS]           = &&op_OP_LESS,
+            [OP_LESS_EQUAL]     = &&op_OP_LESS_EQUAL,
+            [OP_ADD]            = &&op_OP_ADD,
+            [OP_SUBTRACT]       = &&op_OP_SUBTRACT,
+            [OP_MULTIPLY]       = &&op_OP_MULTIPLY,
+            [OP_DIVIDE]         = &&op_OP_DIVIDE,
+            [OP_NOT]            = &&op_OP_NOT,
+            [OP_NEGATE]         = &&op_OP_NEGATE,
+            [OP_RETURN]         = &&op_OP_RETURN,
+            [OP_ADD_CONSTANT]       = &&op_OP_ADD_CONSTANT,
+            [OP_MULTIPLY_CONSTANT]  = &&op_OP_MULTIPLY_CONSTANT,
+            [OP_NOT_GREATER]        = &&op_OP_NOT_GREATER,
+            [OP_NOT_GREATER_EQUAL]  = &&op_OP_NOT_GREATER_EQUAL,
+            [OP_NOT_LESS]           = &&op_OP_NOT_LESS,
+            [OP_NOT_LESS_EQUAL]     = &&op_OP_NOT_LESS_EQUAL,
+            [OP_CONCAT]             = &&op_OP_CONCAT,
+        };
+
+        #define DISPATCH() \
+            do { \
+                INSTRUMENT(); \
+                instruction = read_byte(vm); \
+                goto *dispatchTable[instruction]; \
+            } while(false)
+
+        #define CASE(op)    op_##op:
+        #define DEFAULT     op_unknown:
+        #define NEXT        DISPATCH()
+    #else
+        #define CASE(op)    case op:
+        #define DEFAULT     default:
+        #define NEXT        break
+    #endif
+
+    uint8_t instruction;
+
+    #ifdef CLOX_COMPUTED_GOTO
+    DISPATCH();
+    {
+    #else
+    for(;;) {
+        INSTRUMENT();
+
+        switch (instruction = read_byte(vm)) {
+    #endif
+            CASE(OP_CONSTANT) {
+                Value constant = readConstant(vm);
+                PUSH(constant);
+                NEXT;
+            }
+
+            CASE(OP_CONSTANT_LONG) {
+                Value constant = readConstantLong(vm);
+                PUSH(constant);
+                NEXT;
+            }
+
+            CASE(OP_RETURN) {
+                Value val = pop(vm);
+                writeValue(&vm->out, val);
+                writeChar(&vm->out, '\n');
+                return INTERPRET_OK;
+            }
+
+            CASE(OP_NIL)            PUSH(NIL_VAL);              NEXT;
+            CASE(OP_TRUE)           PUSH(BOOL_VAL(true));       NEXT;
+            CASE(OP_FALSE)          PUSH(BOOL_VAL(false));      NEXT;
+
+            CASE(OP_EQUAL) {
+                Value b = pop(vm);
+                Value* aPtr = vm->stackTop - 1;
+                *aPtr = BOOL_VAL(valuesEqual(*aPtr, b));
+                NEXT;
+            }
+
+            CASE(OP_NOT_EQUAL) {
+                Value b = pop(vm);
+                Value* aPtr = vm->stackTop - 1;
+                *aPtr = BOOL_VAL(!valuesEqual(*aPtr, b));
+                NEXT;
+            }
+
+            CASE(OP_GREATER)        BINARY_OP(BOOL_VAL, >);     NEXT;
+            CASE(OP_GREATER_EQUAL)  BINARY_OP(BOOL_VAL, >=);    NEXT;
+            CASE(OP_LESS)           BINARY_OP(BOOL_VAL, <);     NEXT;
+            CASE(OP_LESS_EQUAL)     BINARY_OP(BOOL_VAL, <=);    NEXT;
+
+            CASE(OP_NEGATE)         UNARY_OP(NUMBER_VAL, -);    NEXT;
+            CASE(OP_NOT) {
+                Value* aPtr = vm->stackTop - 1;
+                *aPtr = BOOL_VAL(isFalsey(*aPtr));
+                NEXT;
+            }
+
+            CASE(OP_ADD) {
+                Value b = peek(vm, 0);
+                Value a = peek(vm, 1);
+
+                if (IS_STRING(a) && IS_STRING(b)) {
+                    if (!concatenate(vm)) {
+                        runtimeError(vm, "Out of memory.");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                } else if (IS_NUMBER(a) && IS_NUMBER(b)) {
+                    BINARY_OP(NUMBER_VAL, +);
+                } else {
+                    runtimeError(vm, "Operands must be two strings or two numbers");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                NEXT;
+            }
+            CASE(OP_SUBTRACT)       BINARY_OP(NUMBER_VAL, -);   NEXT;
+            CASE(OP_MULTIPLY)       BINARY_OP(NUMBER_VAL, *);   NEXT;
+            CASE(OP_DIVIDE)         BINARY_OP(NUMBER_VAL, /);   NEXT;
+
+            // superinstructions; the right operand comes from the constant pool instead of the stack
+            CASE(OP_ADD_CONSTANT) {
+                Value b = readConstant(vm);
+                Value* aPtr = vm->stackTop - 1;
+
+                if (IS_STRING(*aPtr) && IS_STRING(b)) {
+                    // a stays on the stack and b is in the chunk, so both stay rooted
+                    ObjString* result = concatenateStrings(vm, AS_STRING(*aPtr), AS_STRING(b));
+                    if (result == NULL) {
+                        runtimeError(vm, "Out of memory.");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    *aPtr = OBJ_VAL(result);
+                } else if (IS_NUMBER(*aPtr) && IS_NUMBER(b)) {
+                    *aPtr = NUMBER_VAL(AS_NUMBER(*aPtr) + AS_NUMBER(b));
+                } else {
+                    runtimeError(vm, "Operands must be two strings or two numbers");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                NEXT;
+            }
+
+            CASE(OP_MULTIPLY_CONSTANT) {
+                Value b = readConstant(vm);
+                Value* aPtr = vm->stackTop - 1;
+
+                if (!IS_NUMBER(*aPtr) || !IS_NUMBER(b)) {
+                    runtimeError(vm, "Operands must be numbers.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                *aPtr = NUMBER_VAL(AS_NUMBER(*aPtr) * AS_NUMBER(b));
+                NEXT;
+            }
+
+            CASE(OP_NOT_GREATER)        BINARY_OP(NOT_BOOL_VAL, >);     NEXT;
+            CASE(OP_NOT_GREATER_EQUAL)  BINARY_OP(NOT_BOOL_VAL, >=);    NEXT;
+            CASE(OP_NOT_LESS)           BINARY_OP(NOT_BOOL_VAL, <);     NEXT;
+            CASE(OP_NOT_LESS_EQUAL)     BINARY_OP(NOT_BOOL_VAL, <=);    NEXT;
+
+            CASE(OP_CONCAT) {
+                int count = read_byte(vm);
+                // the operands stay on the stack (rooted) until the result is in
+                Value* operands = vm->stackTop - count;
+
+                AddResult added = addValues(vm, operands, count);
+                if (added != ADD_OK) {
+                    runtimeError(vm, added == ADD_WRONG_TYPES
+                        ? "Operands must be two strings or two numbers" : "Out of memory.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                vm->stackTop = operands + 1;
+                NEXT;
+            }
+
+            DEFAULT
+                // verifyChunk rules out unknown opcodes; telling the compiler so lets the
+                // switch drop its range check
+            #ifdef __GNUC__
+                __builtin_unreachable();
+            #else
+                return INTERPRET_COMPILE_ERROR;
+            #endif
+    #ifdef CLOX_COMPUTED_GOTO
+    }
+    #else
+        }
+    }
+    #endif
+
+    #undef CASE
+    #undef DEFAULT
+    #undef NEXT
+    #undef DISPATCH
+    #undef PUSH
+    #undef NOT_BOOL_VAL
+    #undef BINARY_OP
+    #undef UNARY_OP
+}
+
+#undef RUN_NAME
+#undef INSTRUMENT
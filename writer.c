@@ -0,0 +1,40 @@
+#include "common.h"
+#include "number.h"
+#include "writer.h"
+
+void initWriter(Writer* writer, FILE* file) {
+    writer->file = file;
+    writer->length = 0;
+}
+
+void flushWriter(Writer* writer) {
+    if (writer->length > 0) {
+        fwrite(writer->buffer, 1, writer->length, writer->file);
+        writer->length = 0;
+    }
+}
+
+void writeBytes(Writer* writer, const char* bytes, size_t length) {
+    if (length > WRITER_BUFFER_SIZE - writer->length) {
+        flushWriter(writer);
+        // too big to be worth copying through the buffer
+        if (length >= WRITER_BUFFER_SIZE) {
+            fwrite(bytes, 1, length, writer->file);
+            return;
+        }
+    }
+
+    memcpy(writer->buffer + writer->length, bytes, length);
+    writer->length += length;
+}
+
+void writeString(Writer* writer, const char* string) {
+    writeBytes(writer, string, strlen(string));
+}
+
+void writeNumber(Writer* writer, double number) {
+    if (WRITER_BUFFER_SIZE - writer->length < NUMBER_BUFFER_SIZE) {
+        flushWriter(writer);
+    }
+    writer->length += formatNumber(number, writer->buffer + writer->length);
+}
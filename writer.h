@@ -0,0 +1,36 @@
+#ifndef clox_writer_h
+#define clox_writer_h
+
+#include "common.h"
+
+#define WRITER_BUFFER_SIZE 8192
+
+// output collected in a buffer of our own and handed to file in big writes, instead of a
+// stdio call (and lock) per piece. Nothing reaches file until the buffer fills or
+// flushWriter is called, so whoever owns one has to flush it at the points where the
+// output has to be out: before a prompt, at the end of a script, before exit
+typedef struct {
+    FILE* file;
+    size_t length;
+    char buffer[WRITER_BUFFER_SIZE];
+} Writer;
+
+void initWriter(Writer* writer, FILE* file);
+void writeBytes(Writer* writer, const char* bytes, size_t length);
+void writeString(Writer* writer, const char* string);
+// the way printf("%g") would; see formatNumber
+void writeNumber(Writer* writer, double number);
+// hands everything buffered to the file, in one fwrite; from there it's up to the file's
+// own buffering, as with anything else written to it. With nothing buffered it doesn't
+// touch the file at all, so a writer whose file was closed after its last flush is harmless
+void flushWriter(Writer* writer);
+
+static inline void writeChar(Writer* writer, char c) {
+    if (writer->length < WRITER_BUFFER_SIZE) {
+        writer->buffer[writer->length++] = c;
+    } else {
+        writeBytes(writer, &c, 1);
+    }
+}
+
+#endif